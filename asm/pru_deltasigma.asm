@@ -72,31 +72,74 @@ MODE_DELTA_SIG:
     ; Read in task state data
     LBBO    &State, GTask.addr, $sizeof(task_header), $sizeof(State)
 
+    ; Constants for the second order modulator.  Its integrators are signed
+    ; 16 bit values, worked on with a bias of 0x10000 (first integrator) and
+    ; 0x20000 (second integrator) so they stay positive, and saturate at
+    ; +/- 0x7FFF.
+    LDI     r25, 0x8000
+    LDI     r26.w0, 0x8001
+    LDI     r26.w2, 0
+    LDI     r27.w0, 0x7FFF
+    LDI     r27.w2, 1
+    LDI     r28.w0, 0x8001
+    LDI     r28.w2, 1
+    LDI     r29.w0, 0x7FFF
+    LDI     r29.w2, 2
+
     ; Cycle through all configured outputs one at a time
     LDI     Index.Offset, $sizeof(task_header) + $sizeof(State)
 
 DELTA_OUT_LOOP:
     LBBO    &Output, GTask.addr, Index.Offset, $sizeof(Output)
 
-    ; Update integrator state
-    SUB     r1, Output.Value, Output.Quantize
-    ADD     Output.Integrate, Output.Integrate, r1.w0
-    
-    ; Calculate Output State and store quantized value for next loop
-    QBBC    DELTA_OUT_Zero, Output.Integrate, 15
-    LDI     Output.Quantize, 0xC000
+    QBBS    DELTA_SECOND_ORDER, Output.Mode, DELTA_SECOND_ORDER_BIT
+
+    ; Update integrator state.  The integrator stays below 0x4000 and Value
+    ; is at most 0x4000, so after the add bit 14 is the output state, and
+    ; clearing it subtracts the quantized output fed back to the integrator.
+    ; Bit 15 is only ever set when coming from second order mode.
+    ADD     Output.Integrate, Output.Integrate, Output.Value
+    LSR     r3.b0, Output.Integrate, 14
+    CLR     Output.Integrate, Output.Integrate, 14
+    CLR     Output.Integrate, Output.Integrate, 15
     JMP     DELTA_DO_PIN
 
-DELTA_OUT_Zero:
-    LDI     Output.Quantize, 0x0000
+DELTA_SECOND_ORDER:
+    ; Feed back full scale if the last output was on (Integrate2 >= 0)
+    LDI     r2, 0
+    QBBS    DELTA_FEEDBACK, Output.Integrate2, 15
+    LDI     r2, 0x4000
+DELTA_FEEDBACK:
+
+    ; First integrator: Integrate += Value - feedback
+    XOR     r1, Output.Integrate, r25
+    ADD     r1, r1, r25
+    ADD     r1, r1, Output.Value
+    SUB     r1, r1, r2
+    MAX     r1, r1, r26
+    MIN     r1, r1, r27
+    MOV     Output.Integrate, r1.w0
+
+    ; Second integrator: Integrate2 += Integrate - feedback
+    XOR     r3, Output.Integrate2, r25
+    ADD     r3, r3, r25
+    ADD     r3, r3, r1
+    SUB     r3, r3, r2
+    MAX     r3, r3, r28
+    MIN     r3, r3, r29
+    MOV     Output.Integrate2, r3.w0
+
+    ; Output is on if Integrate2 >= 0, which is bit 17 with the bias
+    LSR     r3.b0, r3, 17
 
 DELTA_DO_PIN:
     MOV     r3.b1, Output.Pin
-    MIN     r3.b0, Output.Quantize, 1
     JAL     (GState.Call_Reg).w2, SET_CLR_BIT
 
-    ; Save output state data
-    SBBO    &Output.Integrate, GTask.addr, Index.Offset, $sizeof(Output) - delta_output.Integrate + delta_output.Value
+    ; Save output state data.  Only the integrators are written back, Value,
+    ; Pin and Mode belong to the driver.
+    ADD     r2.w0, Index.Offset, delta_output.Integrate - delta_output.Value
+    SBBO    &Output.Integrate, GTask.addr, r2.w0, $sizeof(Output) - delta_output.Integrate + delta_output.Value
 
     ; ...and loop until we're done
     ADD     Index.Offset, Index.Offset, $sizeof(Output)
@@ -51,9 +51,15 @@ GState  .sassign r0, global_state
 
 State   .sassign r4, encoder_state      ; r4 is assigned to GState.State_Reg0 
 Index   .sassign r6, encoder_index      ; r6 is assigned to GState.State_Reg2 
-Encoder .sassign r8, encoder_chan       ; r8 is assigned to GState.State_Reg4
+Encoder .sassign r7, encoder_chan       ; r7 is assigned to GState.State_Reg3
+Filt    .sassign r3, encoder_filt       ; r3 is assigned to GState.Scratch3
+Gpio    .sassign r26, encoder_gpio      ; r26-r29, r25 holds the PRU inputs
 
 GTask .sassign r12, task_header
+
+    .define 100, Input_Regs             ; register file byte address of r25
+
+    .global __PRU_CREG_PRU_IEP
     
     .text
     
@@ -62,9 +68,17 @@ GTask .sassign r12, task_header
     
     .def MODE_ENCODER
 MODE_ENCODER:
+    JAL     (GState.Call_Reg).w0, ENCODER_SAMPLE
 
-; First writable element in Encoder struct, elements before this are read-only
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
 
+; Sample and decode all channels of the encoder task at GTask.addr once.
+; Also called by the wait task to oversample the inputs while it waits for
+; the next tick.  Uses r0-r11, r25-r29 and GTask.len, returns to Call_Reg.w0
+
+    .def ENCODER_SAMPLE
+ENCODER_SAMPLE:
 
     ; Skip everything if no outputs are configured
     QBEQ    ENCODER_DONE, GTask.len, 0
@@ -77,17 +91,133 @@ MODE_ENCODER:
     ; Overwrite with the xor result since we're done with the mask until next time
     XOR     State.pins, r31, State.pins
 
-    ; Load the write pointer with the task address pointer offset by the number
-    ; of read-only bytes in the per-channel Encoder struct
-    ADD     Index.wraddr, GTask.addr, encoder_chan.AB_State - encoder_chan.A_pin
+    ; Input words of all pins: r25 = PRU inputs, r26-r29 = GPIO0-3 as read by
+    ; the wait task at the start of the tick, inverted like the PRU inputs
+    MOV     r25, State.pins
+    LBBO    &Gpio, GTask.addr, $sizeof(task_header) + $sizeof(encoder_state), $sizeof(encoder_gpio)
+    LDI     r3, PRU_DATA_START
+    LBBO    &r0, r3, pru_statics.gpio0_in - pru_statics.mode, 8
+    XOR     Gpio.Gpio0, Gpio.Gpio0, r0
+    XOR     Gpio.Gpio1, Gpio.Gpio1, r1
+    LBBO    &r0, r3, pru_statics.gpio2_in - pru_statics.mode, 8
+    XOR     Gpio.Gpio2, Gpio.Gpio2, r0
+    XOR     Gpio.Gpio3, Gpio.Gpio3, r1
+
+    ; Time stamp of the input sample: start of this tick plus the IEP count,
+    ; which is reset every tick
+    LBCO    &r2, __PRU_CREG_PRU_IEP, 0x0C, 4
+    LDI     r1, PRU_DATA_START
+    LBBO    &r3, r1, pru_statics.time - pru_statics.mode, $sizeof(pru_statics.time)
+    ADD     r2, r2, r3
 
-    ; Point to the first Encoder definition
-    LDI     Index.Offset, $sizeof(task_header) + $sizeof(encoder_state)
+    ; Point to the first Encoder definition, the write offset skips the
+    ; read-only bytes in the per-channel Encoder struct
+    LDI     Index.Offset, $sizeof(task_header) + $sizeof(encoder_state) + $sizeof(encoder_gpio)
+    LDI     Index.WrOffset, $sizeof(task_header) + $sizeof(encoder_state) + $sizeof(encoder_gpio) + encoder_chan.AB_State - encoder_chan.A_pin
 
 ENCODER_LOOP:
     ; Read previous Encoder state
     LBBO    &Encoder, GTask.addr, Index.Offset, $sizeof(encoder_chan)
 
+    ; Pick the channel inputs out of the input words:
+    ; r0.b1 = A, r0.b2 = B, r0.b3 = Z (in bit 0)
+    ; The pin number / 32 selects the word in r25-r29, which is fetched
+    ; register indirect, the shift only uses the low 5 bits of the pin number
+    LSR     r1.b0, Encoder.A_pin, 5
+    LSL     r1.b0, r1.b0, 2
+    ADD     r1.b0, r1.b0, Input_Regs
+    MVID    r1, *r1.b0
+    LSR     r0.b1, r1, Encoder.A_pin
+
+    LSR     r1.b0, Encoder.B_pin, 5
+    LSL     r1.b0, r1.b0, 2
+    ADD     r1.b0, r1.b0, Input_Regs
+    MVID    r1, *r1.b0
+    LSR     r0.b2, r1, Encoder.B_pin
+
+    LSR     r1.b0, Encoder.Z_pin, 5
+    LSL     r1.b0, r1.b0, 2
+    ADD     r1.b0, r1.b0, Input_Regs
+    MVID    r1, *r1.b0
+    LSR     r0.b3, r1, Encoder.Z_pin
+
+    ; Optional integrator filter, depth in samples is in mode bits 4-7 (one
+    ; sample per tick, more when the wait task oversamples this task)
+    LSR     r1.b0, Encoder.mode, 4
+    QBEQ    FILTER_DONE, r1.b0, 0
+
+    ; The filter state follows the Encoder struct
+    ADD     r1.w2, Index.Offset, $sizeof(encoder_chan)
+    LBBO    &Filt, GTask.addr, r1.w2, $sizeof(encoder_filt)
+
+    ; Each integrator counts up while its input is high and down while it is
+    ; low.  The filtered level only changes when the integrator reaches the
+    ; depth (high) or zero (low), so pulses shorter than depth ticks are lost.
+
+    ; A input
+    AND     r1.b1, Filt.FiltA, 0x7F
+    QBBC    FILT_A_LOW, r0.b1, 0
+    ADD     r1.b1, r1.b1, 1
+    QBGT    FILT_A_KEEP, r1.b1, r1.b0
+    OR      Filt.FiltA, r1.b0, 0x80
+    JMP     FILT_A_DONE
+FILT_A_LOW:
+    QBEQ    FILT_A_ZERO, r1.b1, 0
+    SUB     r1.b1, r1.b1, 1
+    QBNE    FILT_A_KEEP, r1.b1, 0
+FILT_A_ZERO:
+    LDI     Filt.FiltA, 0
+    JMP     FILT_A_DONE
+FILT_A_KEEP:
+    AND     Filt.FiltA, Filt.FiltA, 0x80
+    OR      Filt.FiltA, Filt.FiltA, r1.b1
+FILT_A_DONE:
+    LSR     r0.b1, Filt.FiltA, 7
+
+    ; B input
+    AND     r1.b1, Filt.FiltB, 0x7F
+    QBBC    FILT_B_LOW, r0.b2, 0
+    ADD     r1.b1, r1.b1, 1
+    QBGT    FILT_B_KEEP, r1.b1, r1.b0
+    OR      Filt.FiltB, r1.b0, 0x80
+    JMP     FILT_B_DONE
+FILT_B_LOW:
+    QBEQ    FILT_B_ZERO, r1.b1, 0
+    SUB     r1.b1, r1.b1, 1
+    QBNE    FILT_B_KEEP, r1.b1, 0
+FILT_B_ZERO:
+    LDI     Filt.FiltB, 0
+    JMP     FILT_B_DONE
+FILT_B_KEEP:
+    AND     Filt.FiltB, Filt.FiltB, 0x80
+    OR      Filt.FiltB, Filt.FiltB, r1.b1
+FILT_B_DONE:
+    LSR     r0.b2, Filt.FiltB, 7
+
+    ; Z input
+    AND     r1.b1, Filt.FiltZ, 0x7F
+    QBBC    FILT_Z_LOW, r0.b3, 0
+    ADD     r1.b1, r1.b1, 1
+    QBGT    FILT_Z_KEEP, r1.b1, r1.b0
+    OR      Filt.FiltZ, r1.b0, 0x80
+    JMP     FILT_Z_DONE
+FILT_Z_LOW:
+    QBEQ    FILT_Z_ZERO, r1.b1, 0
+    SUB     r1.b1, r1.b1, 1
+    QBNE    FILT_Z_KEEP, r1.b1, 0
+FILT_Z_ZERO:
+    LDI     Filt.FiltZ, 0
+    JMP     FILT_Z_DONE
+FILT_Z_KEEP:
+    AND     Filt.FiltZ, Filt.FiltZ, 0x80
+    OR      Filt.FiltZ, Filt.FiltZ, r1.b1
+FILT_Z_DONE:
+    LSR     r0.b3, Filt.FiltZ, 7
+
+    SBBO    &Filt, GTask.addr, r1.w2, $sizeof(encoder_filt)
+
+FILTER_DONE:
+
     ; !!!!!!!!!!!!!!!
     ; !!! WARNING !!!
     ; !!!!!!!!!!!!!!!
@@ -98,17 +228,17 @@ ENCODER_LOOP:
     ; If anything changes the alignment of these two structures, THIS CODE
     ; WILL BREAK!
     ;
-    ; GState.State_reg5.w0 = (Encoder.AB_scratch << 8) | Encoder.AB_state
+    ; GState.State_Reg4.w0 = (Encoder.AB_scratch << 8) | Encoder.AB_state
     ;
     ; Use a define to make this easy to update later, if things change
 
-    .define (GState.State_Reg5).w0, Encoder_AB_16 
+    .define (GState.State_Reg4).w0, Encoder_AB_16 
 
     ; Manipulate input bits to generate a LUT index value consisting of:
     ; 0 0 Mode1 Mode0 B_new A_new B_old A_old
-    LSR     Encoder.AB_scratch, State.pins, Encoder.A_pin   ; A into LSB of scratch
+    MOV     Encoder.AB_scratch, r0.b1                       ; A into LSB of scratch
     LSR     Encoder_AB_16, Encoder_AB_16, 1                 ; Shift A into AB_state
-    LSR     Encoder.AB_scratch, State.pins, Encoder.B_pin   ; B into LSB of scratch
+    MOV     Encoder.AB_scratch, r0.b2                       ; B into LSB of scratch
     LSR     Encoder_AB_16, Encoder_AB_16, 1                 ; Shift B into AB_state
 
     ; AB_State is now B_new A_new B_old A_old x x x x
@@ -120,6 +250,17 @@ ENCODER_LOOP:
     ; Lookup count value based on LUT index in AB_scratch
     LBBO    &(GState.Scratch0).b0, State.LUT, Encoder.AB_scratch, 1
 
+    ; LUT result 3 flags an illegal quadrature transition (A and B changed
+    ; in the same tick), count the error and leave the count alone
+    QBNE    QERR_DONE, (GState.Scratch0).b0, 3
+    ADD     r1.w2, Index.Offset, $sizeof(encoder_chan) + encoder_filt.QErr
+    LBBO    &r1.b0, GTask.addr, r1.w2, 1
+    ADD     r1.b0, r1.b0, 1
+    SBBO    &r1.b0, GTask.addr, r1.w2, 1
+    LDI     (GState.Scratch0).b0, 1
+
+QERR_DONE:
+
     ; Update count based on LUT results
     ; PRU only does unsigned math, so LUT result is 0, 1, or 2
     ; and we update the count using newcount = count + LUT - 1
@@ -127,28 +268,51 @@ ENCODER_LOOP:
     ADD     Encoder.count, Encoder.count, (GState.Scratch0).b0
     SUB     Encoder.count, Encoder.count, 1
 
+    ; Remember when the count last changed, for 1/T velocity estimation
+    QBEQ    TS_DONE, (GState.Scratch0).b0, 1
+    MOV     Encoder.Timestamp, r2
+
+TS_DONE:
+
     ; Capture count on rising edge of index pulse
-    QBBC    Z_DONE, State.pins, Encoder.Z_pin               ; No rising edge if new value is zero
+    QBBC    Z_DONE, r0.b3, 0                                ; No rising edge if new value is zero
     QBBS    Z_DONE, Encoder.Z_State, 0                      ; No rising edge if old value is one
 
     ; Rising edge on Z
 
+    ; With index-enable armed (mode bit 2) only the first edge is captured,
+    ; Z_State bit 1 holds the capture until the driver disarms
+    QBBC    Z_CAPTURE, Encoder.mode, 2
+    QBBS    Z_DONE, Encoder.Z_State, 1
+    SET     Encoder.Z_State, Encoder.Z_State, 1
+
+Z_CAPTURE:
     MOV     Encoder.Z_capture, Encoder.count                ; Capture count value
     ADD     Encoder.Z_count, Encoder.Z_count, 1             ; Add one to Z_count so SW knows we saw an index pulse
 
 Z_DONE:
+    ; Release the held capture once the driver disarmed index-enable
+    QBBS    Z_ARMED, Encoder.mode, 2
+    CLR     Encoder.Z_State, Encoder.Z_State, 1
+
+Z_ARMED:
+    ; Remember Z for edge detection on the next pass
+    CLR     Encoder.Z_State, Encoder.Z_State, 0
+    QBBC    Z_SAVED, r0.b3, 0
+    SET     Encoder.Z_State, Encoder.Z_State, 0
+
+Z_SAVED:
 
     ; Save state data for this encoder
-    SBBO    &Encoder.AB_State, Index.wraddr, Index.Offset, $sizeof(encoder_chan) - encoder_chan.AB_State + encoder_chan.A_pin
+    SBBO    &Encoder.AB_State, GTask.addr, Index.WrOffset, $sizeof(encoder_chan) - encoder_chan.AB_State + encoder_chan.A_pin
     
     ; Point to the next Encoder struct and carry on...
-    ADD     Index.Offset, Index.Offset, $sizeof(Encoder)
+    ADD     Index.Offset, Index.Offset, $sizeof(encoder_chan) + $sizeof(encoder_filt)
+    ADD     Index.WrOffset, Index.WrOffset, $sizeof(encoder_chan) + $sizeof(encoder_filt)
     SUB     GTask.len, GTask.len, 1
     QBNE    ENCODER_LOOP, GTask.len, 0
 
 ENCODER_DONE:
     ; No global task data to save, just per-channel data saved above
-
-    ; We're done here...carry on with the next task
-    JMP     NEXT_TASK
+    JMP     (GState.Call_Reg).w0
 
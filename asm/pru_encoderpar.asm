@@ -0,0 +1,228 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_encoderpar.asm                                      //
+;// PRU code decoding all quadrature encoder channels bit-parallel       //
+;//                                                                      //
+;// Author(s): Thomas Gerner                                             //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Initial version, derived from pru_encoder                //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2013  Charles Steinkuehler                             //
+;//                     <charles AT steinkuehler DOT net>                //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+State   .sassign r4, encoder_state      ; r4 is assigned to GState.State_Reg0 
+Par     .sassign r6, encoder_par        ; r6 is assigned to GState.State_Reg2 
+Encoder .sassign r25, encoder_chan      ; r25-r29, the multiplier is not used here
+
+GTask .sassign r12, task_header
+
+    .global __PRU_CREG_PRU_IEP
+    
+    .text
+    
+    .ref NEXT_TASK
+    
+; Quadrature x4 decoding of all channels at once.  The task header dataX holds
+; the distance of the B inputs from the A inputs, dataY the distance of the
+; index inputs (0 = no index).  All inputs come from one input word, either
+; the PRU inputs or one GPIO bank (encoder_par.Bank).  Shifting the input word by these distances
+; lines up A, B and Z of every channel on the A input bit, so the count
+; direction of all channels is found with a handful of word wide operations.
+; Only the channels that counted, saw an index pulse or a quadrature error get
+; their channel struct loaded and written back.
+;
+; The channel structs are laid out like the ones of the regular encoder task,
+; so the driver and other tasks (closed loop stepgen) read them the same way.
+
+    .def MODE_ENCODER_PAR
+MODE_ENCODER_PAR:
+    JAL     (GState.Call_Reg).w0, ENCPAR_SAMPLE
+
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
+
+; Sample and decode all channels of the encoder task at GTask.addr once.
+; Also called by the wait task to oversample the inputs while it waits for
+; the next tick.  Uses r0-r11, r25-r29 and GTask.len, returns to Call_Reg.w0
+
+    .def ENCPAR_SAMPLE
+ENCPAR_SAMPLE:
+
+    ; Skip everything if no channels are configured
+    QBEQ    ENCPAR_DONE, GTask.len, 0
+
+    ; Read in task state data, State.LUT points to the bit-parallel state
+    LBBO    &State, GTask.addr, $sizeof(task_header), $sizeof(encoder_state)
+    LBBO    &Par, State.LUT, 0, encoder_par.Arm - encoder_par.AMask
+
+    ; Read and optionally invert the input pins, either the PRU inputs or
+    ; the GPIO bank read by the wait task at the start of the tick
+    QBNE    ENCPAR_GPIO, Par.Bank, 0
+    XOR     State.pins, r31, State.pins
+    JMP     ENCPAR_INPUTS
+ENCPAR_GPIO:
+    SUB     r1, Par.Bank, 1
+    LSL     r1, r1, 2
+    ADD     r1, r1, pru_statics.gpio0_in - pru_statics.mode
+    LDI     r3, PRU_DATA_START
+    LBBO    &r2, r3, r1, 4
+    XOR     State.pins, r2, State.pins
+
+ENCPAR_INPUTS:
+
+    ; Time stamp of the input sample: start of this tick plus the IEP count,
+    ; which is reset every tick
+    LBCO    &r2, __PRU_CREG_PRU_IEP, 0x0C, 4
+    LDI     r1, PRU_DATA_START
+    LBBO    &r3, r1, pru_statics.time - pru_statics.mode, $sizeof(pru_statics.time)
+    ADD     r2, r2, r3
+
+    ; Line up the inputs of all channels on their A bit:
+    ; r8 = A new, r9 = B new, r10 = A old, r11 = B old
+    AND     r8, State.pins, Par.AMask
+    LSR     r9, State.pins, GTask.dataX
+    AND     r9, r9, Par.AMask
+    AND     r10, Par.Prev, Par.AMask
+    LSR     r11, Par.Prev, GTask.dataX
+    AND     r11, r11, Par.AMask
+
+    ; r3 = A and B changed (quadrature error)
+    ; r0 = exactly one of A and B changed (count)
+    ; r1 = count up, which is the case when A new differs from B old
+    ;      (same direction as the x4 quadrature LUT in encoder.c)
+    XOR     r0, r8, r10
+    XOR     r1, r9, r11
+    AND     r3, r0, r1
+    XOR     r0, r0, r1
+    XOR     r1, r8, r11
+    AND     r1, r1, r0
+
+    ; r10 = rising edge on the index input
+    LDI     r10, 0
+    QBEQ    ENCPAR_Z_EDGES, GTask.dataY, 0
+    LSR     r10, State.pins, GTask.dataY
+    LSR     r11, Par.Prev, GTask.dataY
+    NOT     r11, r11
+    AND     r10, r10, r11
+    AND     r10, r10, Par.AMask
+
+ENCPAR_Z_EDGES:
+    ; Remember the inputs for the next pass
+    MOV     Par.Prev, State.pins
+    SBBO    &Par.Prev, State.LUT, encoder_par.Prev, $sizeof(encoder_par.Prev)
+
+    ; Index-enable handshake: a channel armed by the driver (Arm) captures
+    ; only the first index edge, Held keeps it until the driver disarms.
+    ; r6 = Arm, r7 = Held, r4 = held channels the driver disarmed
+    LBBO    &r6, State.LUT, encoder_par.Arm, $sizeof(encoder_par.Arm) + $sizeof(encoder_par.Held)
+    NOT     r4, r6
+    AND     r4, r4, r7
+    AND     r7, r7, r6
+    NOT     r8, r7
+    AND     r10, r10, r8                    ; r10 = index edges to capture
+    AND     r8, r10, r6
+    OR      r7, r7, r8
+    SBBO    &r7, State.LUT, encoder_par.Held, $sizeof(encoder_par.Held)
+
+    ; r9 = channels that need an update
+    OR      r9, r0, r3
+    OR      r9, r9, r10
+    OR      r9, r9, r4
+
+    ; r4 = Held, copied to Z_State bit 1 of every updated channel
+    MOV     r4, r7
+
+ENCPAR_LOOP:
+    QBEQ    ENCPAR_DONE, r9, 0
+
+    ; r8.b0 = A bit of the next channel to update
+    LMBD    r8.b0, r9, 1
+    CLR     r9, r9, r8.b0
+
+    ; Look up the channel number, the map of A bits to channels follows
+    ; the encoder_par struct
+    ADD     r11.w2, r8.b0, $sizeof(encoder_par)
+    LBBO    &r11.b0, State.LUT, r11.w2, 1
+
+    ; r11.w0 = channel offset from the task address, the channels are
+    ; $sizeof(encoder_chan) + $sizeof(encoder_filt) = 24 bytes apart
+    LSL     r11.w2, r11.b0, 3
+    LSL     r11.w0, r11.b0, 4
+    ADD     r11.w0, r11.w0, r11.w2
+    ADD     r11.w0, r11.w0, $sizeof(task_header) + $sizeof(encoder_state) + $sizeof(encoder_gpio)
+
+    LBBO    &Encoder, GTask.addr, r11.w0, $sizeof(encoder_chan)
+
+    ; Update count and remember when it changed
+    QBBC    ENCPAR_COUNTED, r0, r8.b0
+    MOV     Encoder.Timestamp, r2
+    ADD     Encoder.count, Encoder.count, 1
+    QBBS    ENCPAR_COUNTED, r1, r8.b0
+    SUB     Encoder.count, Encoder.count, 2
+
+ENCPAR_COUNTED:
+    ; Capture count on rising edge of index pulse
+    QBBC    ENCPAR_Z_DONE, r10, r8.b0
+    MOV     Encoder.Z_capture, Encoder.count
+    ADD     Encoder.Z_count, Encoder.Z_count, 1
+
+ENCPAR_Z_DONE:
+    CLR     Encoder.Z_State, Encoder.Z_State, 1
+    QBBC    ENCPAR_HELD_DONE, r4, r8.b0
+    SET     Encoder.Z_State, Encoder.Z_State, 1
+
+ENCPAR_HELD_DONE:
+    ; Count quadrature errors, the count is left alone
+    QBBC    ENCPAR_QERR_DONE, r3, r8.b0
+    ADD     r11.w2, r11.w0, $sizeof(encoder_chan) + encoder_filt.QErr
+    LBBO    &r6.b0, GTask.addr, r11.w2, 1
+    ADD     r6.b0, r6.b0, 1
+    SBBO    &r6.b0, GTask.addr, r11.w2, 1
+
+ENCPAR_QERR_DONE:
+    ; Save state data for this encoder, the pin and mode bytes are read-only
+    ADD     r11.w0, r11.w0, encoder_chan.AB_State - encoder_chan.A_pin
+    SBBO    &Encoder.AB_State, GTask.addr, r11.w0, $sizeof(encoder_chan) - encoder_chan.AB_State + encoder_chan.A_pin
+    JMP     ENCPAR_LOOP
+
+ENCPAR_DONE:
+    JMP     (GState.Call_Reg).w0
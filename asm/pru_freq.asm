@@ -0,0 +1,121 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_freq.asm                                            //
+;// PRU code implementing a frequency counter task                       //
+;//                                                                      //
+;// Author(s): Thomas Gerner                                             //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Initial version                                          //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2026  Thomas Gerner                                    //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+Chan    .sassign r4, freq_chan      ; r4-r6 are assigned to GState.State_Reg0-2
+                                    ; r7.w0 is the offset of the current channel
+Input   .sassign r25, read_state    ; r25-r29, the input words of all pins
+
+GTask   .sassign r12, task_header
+
+    .define 100, Input_Regs         ; register file byte address of r25
+
+    .text
+    
+    .def MODE_FREQ
+    
+    .ref NEXT_TASK
+
+    ; Counts the rising edges of each input and keeps the time stamp of the
+    ; last one.  The driver measures the frequency as edges per time between
+    ; the last edges of two servo periods (1/T), so it stays accurate far
+    ; below one edge per servo period.
+
+MODE_FREQ:
+
+    ; Skip everything if no channels are configured
+    QBEQ    FREQ_DONE, GTask.len, 0
+
+    ; Input words of all pins: r25 = PRU inputs, r26-r29 = GPIO0-3 as read by
+    ; the wait task at the start of the tick
+    MOV     Input.Pins, r31
+    LDI     r3, PRU_DATA_START
+    LBBO    &Input.Gpio0, r3, pru_statics.gpio0_in - pru_statics.mode, 16
+
+    ; Time stamp of the input sample: start of this tick plus the IEP count,
+    ; which is reset every tick
+    LBCO    &r2, __PRU_CREG_PRU_IEP, 0x0C, 4
+    LBBO    &r3, r3, pru_statics.time - pru_statics.mode, $sizeof(pru_statics.time)
+    ADD     r2, r2, r3
+
+    LDI     r7.w0, $sizeof(task_header)
+
+FREQ_LOOP:
+    LBBO    &Chan, GTask.addr, r7.w0, $sizeof(freq_chan)
+
+    ; Fetch the input word register indirect, the shift only uses the low
+    ; 5 bits of the pin number
+    LSR     r1.b0, Chan.Pin, 5
+    LSL     r1.b0, r1.b0, 2
+    ADD     r1.b0, r1.b0, Input_Regs
+    MVID    r1, *r1.b0
+    LSR     r1, r1, Chan.Pin
+    AND     r1.b0, r1.b0, 1
+
+    ; Nothing to do unless the input changed
+    QBEQ    FREQ_NEXT, r1.b0, Chan.Level
+    MOV     Chan.Level, r1.b0
+    QBEQ    FREQ_SAVE, r1.b0, 0
+
+    ; Rising edge
+    ADD     Chan.Count, Chan.Count, 1
+    MOV     Chan.Time, r2
+
+FREQ_SAVE:
+    ADD     r7.w2, r7.w0, freq_chan.Level - freq_chan.Pin
+    SBBO    &Chan.Level, GTask.addr, r7.w2, $sizeof(freq_chan) - freq_chan.Level + freq_chan.Pin
+
+FREQ_NEXT:
+    ADD     r7.w0, r7.w0, $sizeof(freq_chan)
+    SUB     GTask.len, GTask.len, 1
+    QBNE    FREQ_LOOP, GTask.len, 0
+
+FREQ_DONE:
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
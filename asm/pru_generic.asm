@@ -155,25 +155,40 @@ START:
     JMP     MAINLOOP
 
     .ref MODE_WAIT
+    .ref MODE_WRITE
+    .ref MODE_READ
     .ref MODE_STEP_DIR
+    .ref MODE_UP_DOWN
     .ref MODE_DELTA_SIG
     .ref MODE_PWM
     .ref MODE_ENCODER
     .ref MODE_STEP_PHASE
     .ref MODE_EDGESTEP_DIR
+    .ref MODE_STEP_DIR_CL
+    .ref MODE_STEP_MICRO
+    .ref MODE_ENCODER_PAR
+    .ref MODE_FREQ
+    .ref MODE_STEP_GEAR
+    .ref MODE_PSO
     
 TASKTABLE:
     JMP     NEXT_TASK           ; MODE_NONE
     JMP     MODE_WAIT
-    JMP     NEXT_TASK           ;     JMP     MODE_WRITE
-    JMP     NEXT_TASK           ;     JMP     MODE_READ
+    JMP     MODE_WRITE
+    JMP     MODE_READ
     JMP     MODE_STEP_DIR
-    JMP     NEXT_TASK           ;     JMP     MODE_UP_DOWN
+    JMP     MODE_UP_DOWN
     JMP     MODE_DELTA_SIG
     JMP     MODE_PWM
     JMP     MODE_ENCODER
     JMP     MODE_STEP_PHASE
     JMP     MODE_EDGESTEP_DIR
+    JMP     MODE_STEP_DIR_CL
+    JMP     MODE_STEP_MICRO
+    JMP     MODE_ENCODER_PAR
+    JMP     MODE_FREQ
+    JMP     MODE_STEP_GEAR
+    JMP     MODE_PSO
 TASKTABLEEND:
 
     JMP     START
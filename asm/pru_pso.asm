@@ -0,0 +1,146 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_pso.asm                                             //
+;// PRU code implementing a position synchronized output task            //
+;//                                                                      //
+;// Author(s): Thomas Gerner                                             //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Initial version                                          //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2026  Thomas Gerner                                    //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+Pso     .sassign r4, pso_state      ; r4-r8 are assigned to GState.State_Reg0-4
+
+GTask   .sassign r12, task_header
+
+    .text
+    
+    .def MODE_PSO
+    
+    .ref NEXT_TASK
+    .ref SET_CLR_BIT
+
+    ; Position synchronized output.  Every tick the watched position (a
+    ; stepgen Pos or an encoder count) is compared with the table entry at
+    ; Head, and when it reaches or crosses the entry the output toggles, or
+    ; pulses for Width ticks, and Head moves on.  The driver refills the
+    ; table up to Tail as the entries are consumed.  All entries passed in
+    ; one tick are consumed in that tick: their toggles add up and their
+    ; pulses merge into one.
+    ;
+    ; This task follows the stepgen and encoder tasks in the task list, so it
+    ; sees the position of the current tick, and the output changes at the
+    ; same tick as the step output reaching the position.
+    ;
+    ; Bit 0 of Flags enables the compare.  While it is cleared the table is
+    ; dropped (Head = Tail) and the output is idle.
+
+MODE_PSO:
+
+    ; Read in task state data
+    LBBO    &Pso, GTask.addr, $sizeof(task_header), $sizeof(Pso)
+
+    ; r1 = position of this tick
+    MOV     r1, Pso.SrcAddr
+    LBBO    &r1, r1, 0, 4
+
+    QBBS    PSO_ENABLED, Pso.Flags, PSO_ENABLE_BIT
+    MOV     Pso.Head, Pso.Tail
+    LDI     Pso.Timer, 0
+    LDI     Pso.Level, 0
+    JMP     PSO_OUT
+
+PSO_ENABLED:
+
+    ; End the current pulse when its time is up
+    QBEQ    PSO_NEXT, Pso.Timer, 0
+    SUB     Pso.Timer, Pso.Timer, 1
+    QBNE    PSO_NEXT, Pso.Timer, 0
+    LDI     Pso.Level, 0
+PSO_NEXT:
+    ; Nothing to do while the table is empty
+    QBEQ    PSO_OUT, Pso.Head, Pso.Tail
+
+    ; r2 = table entry at Head
+    LSL     r3.w0, Pso.Head, 2
+    ADD     r3.w0, r3.w0, $sizeof(task_header) + $sizeof(pso_state)
+    LBBO    &r2, GTask.addr, r3.w0, 4
+
+    ; The entry is passed if it lies between Last and the position of this
+    ; tick, both included, in the direction of travel: the distances from
+    ; Last to the entry and from the entry to the position have the same sign
+    SUB     r3, r1, r2                  ; r3 = position - entry
+    SUB     r2, r2, Pso.Last            ; r2 = entry - Last
+    QBEQ    PSO_FIRE, r3, 0
+    QBEQ    PSO_FIRE, r2, 0
+    XOR     r2, r2, r3
+    QBBS    PSO_OUT, r2, 31
+
+PSO_FIRE:
+    ; The next entry is compared from this one, so only entries further on
+    ; in the direction of travel are passed in the same tick
+    SUB     Pso.Last, r1, r3
+    ADD     Pso.Head, Pso.Head, 1
+    AND     Pso.Head, Pso.Head, PSO_TABLE_SIZE - 1
+    ADD     Pso.Fired, Pso.Fired, 1
+
+    QBNE    PSO_PULSE, Pso.Width, 0
+    XOR     Pso.Level, Pso.Level, 1
+    JMP     PSO_NEXT
+PSO_PULSE:
+    LDI     Pso.Level, 1
+    MOV     Pso.Timer, Pso.Width
+    JMP     PSO_NEXT
+
+PSO_OUT:
+    MOV     Pso.Last, r1
+
+    ; The output is set every tick, the wait task writes it at the next tick
+    MOV     r3.b1, GTask.dataX
+    XOR     r3.b0, Pso.Level, Pso.Invert
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Save the PRU owned state
+    SBBO    &Pso.Last, GTask.addr, $sizeof(task_header) + pso_state.Last - pso_state.SrcAddr, $sizeof(Pso) - pso_state.Last + pso_state.SrcAddr
+
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
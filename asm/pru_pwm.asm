@@ -53,9 +53,8 @@
 
 GState .sassign r0, global_state
 
-State  .sassign r4, pwm_state      ; r4 is assigned to GState.State_Reg0 
-Index  .sassign r6, pwm_index      ; r6 is assigned to GState.State_Reg2 
-Output .sassign r7, pwm_output     ; r7 is assigned to GState.State_Reg3
+State  .sassign r4, pwm_state      ; r4-r7 are assigned to GState.State_Reg0-3
+Output .sassign r8, pwm_output
 
 GTask .sassign r12, task_header
 
@@ -64,6 +63,11 @@ GTask .sassign r12, task_header
     .ref NEXT_TASK
     .ref SET_CLR_BIT
     
+    ; The outputs live in a table sorted by Value, so each tick only has to
+    ; look at the next pending clear edge instead of scanning every output.
+    ; The driver fills the table not in use and requests it in State.Table,
+    ; which is picked up when the period wraps.
+
     .def MODE_PWM
 MODE_PWM:
 
@@ -77,58 +81,55 @@ MODE_PWM:
     ADD     State.T_Prescale, State.T_Prescale, 1
 
     ; Prescale finished?
-    QBLT    PWM_DONE, State.Prescale, State.T_Prescale
+    QBLT    PWM_SAVE, State.Prescale, State.T_Prescale
     LDI     State.T_Prescale, 0
 
     ; Increment Period Counter
     ADD     State.T_Period, State.T_Period, 1
 
     ; Are we finished with this period?
-    QBLE    PrescaleNE, State.Period, State.T_Period
+    QBLE    PWM_CLR_LOOP, State.Period, State.T_Period
     LDI     State.T_Period, 0
 
-    LDI     Index.Offset, $sizeof(task_header) + $sizeof(State)
+    ; Switch to the table requested by the driver
+    MOV     State.Active, State.Table
+    MOV     State.Next, State.Table
+    MOV     r2.w0, State.Table
 
     ; Set all outputs when period wraps
 PWM_SET_LOOP:
-    LBBO    &Output, GTask.addr, Index.Offset, $sizeof(Output)
+    LBBO    &Output, GTask.addr, r2.w0, $sizeof(Output)
 
     ; Only set if Value != 0, otherwise clear
     MOV     r3.b1, Output.Pin
     MIN     r3.b0, Output.Value, 1
     JAL     (GState.Call_Reg).w2, SET_CLR_BIT
 
-    ADD     Index.Offset, Index.Offset, $sizeof(Output)
+    ; Outputs with Value == 0 sort first and are already cleared, skip them
+    QBNE    PWM_SET_NEXT, Output.Value, 0
+    ADD     State.Next, State.Next, $sizeof(Output)
+PWM_SET_NEXT:
+    ADD     r2.w0, r2.w0, $sizeof(Output)
     SUB     GTask.len, GTask.len, 1
     QBNE    PWM_SET_LOOP, GTask.len, 0
-    JMP     PWM_DONE
-
-PrescaleNE:
-
-    ; Cycle through outputs and see if we need to clear any
-    LDI     Index.Offset, $sizeof(task_header) + $sizeof(State)
+    JMP     PWM_SAVE
 
-PWM_OUT_LOOP:
-    LBBO    &Output.Value, GTask.addr, Index.Offset, $sizeof(Output)
-
-    QBNE    ValueNE, State.T_Period, Output.Value
-;  CLR     GState.PRU_Out, Output.Pin
+    ; Clear every output whose edge is due, the table end entry stops the loop
+PWM_CLR_LOOP:
+    LBBO    &Output, GTask.addr, State.Next, $sizeof(Output)
+    QBLT    PWM_SAVE, Output.Value, State.T_Period
 
     MOV     r3.b1, Output.Pin
     LDI     r3.b0, 0
     JAL     (GState.Call_Reg).w2, SET_CLR_BIT
 
-ValueNE:
-
-    ADD     Index.Offset, Index.Offset, $sizeof(Output)
-    SUB     GTask.len, GTask.len, 1
-
-    QBNE    PWM_OUT_LOOP, GTask.len, 0
+    ADD     State.Next, State.Next, $sizeof(Output)
+    JMP     PWM_CLR_LOOP
 
-PWM_DONE:
+PWM_SAVE:
     ; Save channel state data
     SBBO    &State.T_Prescale, GTask.addr, $sizeof(task_header) + pwm_state.T_Prescale - pwm_state.Prescale, $sizeof(pwm_state) - pwm_state.T_Prescale + pwm_state.Prescale
 
+PWM_DONE:
     ; We're done here...carry on with the next task
     JMP     NEXT_TASK
-
@@ -9,6 +9,8 @@
 ;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
 ;//                                                                      //
 ;// Last change:                                                         //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Input snapshot and debounced inputs                      //
 ;// 2013-May-20 Charles Steinkuehler                                     //
 ;//             Initial version                                          //
 ;//----------------------------------------------------------------------//
@@ -45,19 +47,81 @@
 ;// information, go to www.linuxcnc.org.                                 //
 ;//----------------------------------------------------------------------//
 
+    .include "pru_tasks.inc"
+
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+Input   .sassign r4, read_input     ; r4-r5 are assigned to GState.State_Reg0-1
+Index   .sassign r6, encoder_index  ; r6 is assigned to GState.State_Reg2
+Snap    .sassign r25, read_state    ; r25-r29, the input words of all pins
+
+GTask   .sassign r12, task_header
+
+    .define 100, Input_Regs         ; register file byte address of r25
+
     .text
     
     .def MODE_READ
     
     .ref NEXT_TASK
     
+    ; Takes a snapshot of the PRU inputs and the GPIO banks read by the wait
+    ; task at the start of the tick, then debounces the configured inputs:
+    ; a new level is taken over once it was stable for Filter + 1 ticks, and
+    ; counted as an edge.
+
 MODE_READ:
 
-    ; Move along...nothing to see here...
-    ; ...or feel free to write this code!
+    ; Input words of all pins: r25 = PRU inputs, r26-r29 = GPIO0-3
+    MOV     Snap.Pins, r31
+    LDI     r3, PRU_DATA_START
+    LBBO    &Snap.Gpio0, r3, pru_statics.gpio0_in - pru_statics.mode, 16
+    SBBO    &Snap, GTask.addr, $sizeof(task_header), $sizeof(read_state)
+
+    ; Skip the rest if no inputs are configured
+    QBEQ    READ_DONE, GTask.len, 0
 
-    ; <useful-code-goes-here>
+    ; The write offset skips the read-only bytes of the input struct
+    LDI     Index.Offset, $sizeof(task_header) + $sizeof(read_state)
+    LDI     Index.WrOffset, $sizeof(task_header) + $sizeof(read_state) + read_input.Count - read_input.Pin
 
+READ_LOOP:
+    LBBO    &Input, GTask.addr, Index.Offset, $sizeof(read_input)
+
+    ; Fetch the input word register indirect, the shift only uses the low
+    ; 5 bits of the pin number
+    LSR     r1.b0, Input.Pin, 5
+    LSL     r1.b0, r1.b0, 2
+    ADD     r1.b0, r1.b0, Input_Regs
+    MVID    r1, *r1.b0
+    LSR     r1, r1, Input.Pin
+    AND     r2.b0, r1.b0, 1
+
+    ; Input equal to the debounced state, restart the debounce time
+    QBNE    READ_CHANGED, r2.b0, Input.State
+    LDI     Input.Count, 0
+    JMP     READ_NEXT
+
+READ_CHANGED:
+    ADD     Input.Count, Input.Count, 1
+    QBGE    READ_NEXT, Input.Count, Input.Filter
+
+    ; Stable long enough, take over the new level
+    MOV     Input.State, r2.b0
+    LDI     Input.Count, 0
+    ADD     Input.Edges, Input.Edges, 1
+
+READ_NEXT:
+    SBBO    &Input.Count, GTask.addr, Index.WrOffset, $sizeof(read_input) - read_input.Count + read_input.Pin
+
+    ADD     Index.Offset, Index.Offset, $sizeof(read_input)
+    ADD     Index.WrOffset, Index.WrOffset, $sizeof(read_input)
+    SUB     GTask.len, GTask.len, 1
+    QBNE    READ_LOOP, GTask.len, 0
+
+READ_DONE:
     ; We're done here...carry on with the next task
     JMP     NEXT_TASK
-
@@ -0,0 +1,159 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_safe.asm                                            //
+;// PRU code forcing all outputs to a safe state on a latched fault      //
+;//                                                                      //
+;// Author(s): Thomas Gerner                                             //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Initial version, forces all outputs safe on a            //
+;//             latched fault                                            //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2026  Thomas Gerner                                    //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState .sassign r0, global_state
+
+GTask .sassign r12, task_header
+
+    .text
+    
+    .def SAFE_OUTPUTS
+
+; Walks the task list once around, starting after the current task (the wait
+; task), and forces the outputs of every task to a safe state:
+;   - step generators: Rate = 0, closed loop correction and gearing disengaged
+;   - pwmgen: all values 0, in both output tables
+;   - delta-sigma: all values 0, back to the first order modulator
+;   - write task: the safe masks written by the driver replace the live ones
+;   - position synchronized outputs: disabled, which also drops their tables
+; Called every tick while a fault is latched.  The driver stops writing the
+; outputs once it sees the fault, until then this overrides whatever it wrote
+; by the next tick.  Uses r1-r7, returns to Call_Reg.w0
+
+SAFE_OUTPUTS:
+    ZERO    &r4, 4                              ; r4 = 0, source for zeroing
+    LBBO    &r1, GTask.addr, task_header.addr - task_header.mode, $sizeof(task_header.addr)
+
+SAFE_LOOP:
+    QBEQ    SAFE_DONE, r1, GTask.addr
+
+    ; r2.b0 = mode, r2.b1 = len
+    LBBO    &r2, r1, 0, 4
+
+    QBEQ    SAFE_STEP, r2.b0, eMODE_STEP_DIR
+    QBEQ    SAFE_STEP, r2.b0, eMODE_UP_DOWN
+    QBEQ    SAFE_STEP, r2.b0, eMODE_STEP_PHASE
+    QBEQ    SAFE_STEP, r2.b0, eMODE_EDGESTEP_DIR
+    QBEQ    SAFE_STEP, r2.b0, eMODE_STEP_DIR_CL
+    QBEQ    SAFE_STEP, r2.b0, eMODE_STEP_MICRO
+    QBEQ    SAFE_STEP, r2.b0, eMODE_STEP_GEAR
+    QBEQ    SAFE_PWM, r2.b0, eMODE_PWM
+    QBEQ    SAFE_DELTA, r2.b0, eMODE_DELTA_SIG
+    QBEQ    SAFE_WRITE, r2.b0, eMODE_WRITE
+    QBEQ    SAFE_PSO, r2.b0, eMODE_PSO
+    JMP     SAFE_NEXT
+
+SAFE_STEP:
+    ; Rate is the first word of the state of all step generator classes
+    SBBO    &r4, r1, $sizeof(task_header), 4
+
+    QBEQ    SAFE_CL, r2.b0, eMODE_STEP_DIR_CL
+    QBNE    SAFE_NEXT, r2.b0, eMODE_STEP_GEAR
+    LDI     r3.w0, $sizeof(task_header) + $sizeof(stepdir_state) + stepgear_state.Flags - stepgear_state.EncAddr
+
+SAFE_DISABLE:
+    ; Clear the enable bit (bit 0) of the Flags byte at offset r3.w0
+    LBBO    &r2.b2, r1, r3.w0, 1
+    CLR     r2.b2, r2.b2, 0
+    SBBO    &r2.b2, r1, r3.w0, 1
+    JMP     SAFE_NEXT
+
+SAFE_CL:
+    LDI     r3.w0, $sizeof(task_header) + $sizeof(stepdir_state) + stepcl_state.Flags - stepcl_state.EncAddr
+    JMP     SAFE_DISABLE
+
+SAFE_PSO:
+    LDI     r3.w0, $sizeof(task_header) + pso_state.Flags - pso_state.SrcAddr
+    JMP     SAFE_DISABLE
+
+SAFE_PWM:
+    ; Both tables have len + 1 entries, the table end entries are kept
+    ADD     r5.w0, r2.b1, 1
+    LSL     r5.w0, r5.w0, 1
+    LDI     r5.w2, PWM_TABLE_END
+    LDI     r3.w0, $sizeof(task_header) + $sizeof(pwm_state)
+SAFE_PWM_LOOP:
+    LBBO    &r6.w0, r1, r3.w0, 2
+    QBEQ    SAFE_PWM_END, r6.w0, r5.w2
+    SBBO    &r4, r1, r3.w0, 2
+SAFE_PWM_END:
+    ADD     r3.w0, r3.w0, $sizeof(pwm_output)
+    SUB     r5.w0, r5.w0, 1
+    QBNE    SAFE_PWM_LOOP, r5.w0, 0
+    JMP     SAFE_NEXT
+
+SAFE_DELTA:
+    ; Value, Mode and the first integrator are cleared, so the first order
+    ; modulator keeps the output low
+    LDI     r3.w0, $sizeof(task_header) + $sizeof(delta_state)
+SAFE_DELTA_LOOP:
+    QBEQ    SAFE_NEXT, r2.b1, 0
+    SBBO    &r4, r1, r3.w0, $sizeof(delta_output.Value)
+    ADD     r3.w2, r3.w0, delta_output.Mode - delta_output.Value
+    SBBO    &r4, r1, r3.w2, $sizeof(delta_output.Mode) + $sizeof(delta_output.Integrate)
+    ADD     r3.w0, r3.w0, $sizeof(delta_output)
+    SUB     r2.b1, r2.b1, 1
+    JMP     SAFE_DELTA_LOOP
+
+SAFE_WRITE:
+    ; Copy the safe masks over the live ones, r4 is reloaded afterwards
+    LBBO    &r4, r1, $sizeof(task_header) + write_state.SafeGpio0Clr - write_state.Gpio0Clr, 16
+    SBBO    &r4, r1, $sizeof(task_header), 16
+    LBBO    &r4, r1, $sizeof(task_header) + write_state.SafeGpio2Clr - write_state.Gpio0Clr, 16
+    SBBO    &r4, r1, $sizeof(task_header) + write_state.Gpio2Clr - write_state.Gpio0Clr, 16
+    LBBO    &r4, r1, $sizeof(task_header) + write_state.SafePruClr - write_state.Gpio0Clr, 8
+    SBBO    &r4, r1, $sizeof(task_header) + write_state.PruClr - write_state.Gpio0Clr, 8
+    ZERO    &r4, 4
+
+SAFE_NEXT:
+    LBBO    &r1, r1, task_header.addr - task_header.mode, $sizeof(task_header.addr)
+    JMP     SAFE_LOOP
+
+SAFE_DONE:
+    JMP     (GState.Call_Reg).w0
@@ -0,0 +1,265 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_stepdircl.asm                                       //
+;// PRU code implementing closed loop step/dir generation task           //
+;//                                                                      //
+;// Author(s): Charles Steinkuehler                                      //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Derived from step/dir, added encoder correction steps    //
+;// 2013-May    Charles Steinkuehler                                     //
+;//             Split into several files                                 //
+;//             Altered main loop to support a linked list of tasks      //
+;//             Added support for GPIO pins in addition to PRU outputs   //
+;// 2012-Dec-27 Charles Steinkuehler                                     //
+;//             Initial version                                          //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2013  Charles Steinkuehler                             //
+;//                     <charles AT steinkuehler DOT net>                //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState .sassign r0, global_state
+
+State .sassign r4, stepdir_state ; r4 is assigned to GState.State_Reg0
+
+CLoop .sassign r25, stepcl_state ; r25 is assigned to GState.Mul_Status, the multiplier is not used here
+
+GTask .sassign r12, task_header
+
+    .define 31, DirHoldBit      
+    .define 30, DirChgBit       
+    .define 29, PulseHoldBit    
+    .define 28, GuardBit        
+    .define 27, StepBit         
+
+    .define 0x1F, HoldMask        
+    .define 0x3F, DirHoldMask     
+
+    .text
+    
+    .def MODE_STEP_DIR_CL
+
+    .ref NEXT_TASK
+    .ref SET_CLR_BIT
+
+MODE_STEP_DIR_CL:
+
+    ; Read in task state data
+    LBBO    &State, GTask.addr, $sizeof(task_header), $sizeof(State)
+    LBBO    &CLoop, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state), $sizeof(CLoop)
+
+    ; Accumulator MSBs are used for state/status encoding, see pru_stepdir.asm
+
+    ; If the accumulator overflow bit is set here, we are holding for some reason
+    QBBS    SDC_ACC_HOLD, State.Accum, StepBit
+    ADD     State.Accum, State.Accum, State.Rate
+SDC_ACC_HOLD:
+
+    ; Read the low 16 bits of the linked encoder count, plenty for the following error
+    MOV     r3, CLoop.EncAddr
+    LBBO    &r1.w0, r3, 0, 2
+
+    QBBS    SDC_CL_ACTIVE, CLoop.Flags, STEPCL_ENABLE_BIT
+
+    ; Closed loop is disabled, track the encoder so enabling starts without error
+    MOV     (CLoop.Expected).w2, r1.w0
+    LDI     (CLoop.Expected).w0, 0
+
+SDC_CL_ACTIVE:
+
+    ; Following error in encoder counts, sign extended to 32 bits:
+    ; r2 = integer part of Expected - encoder count
+    SUB     r2.w0, (CLoop.Expected).w2, r1.w0
+    LDI     r2.w2, 0
+    QBBC    SDC_ERR_POS, r2, 15
+    LDI     r2.w2, 0xFFFF
+SDC_ERR_POS:
+
+    ; r1.w0 = absolute value of the following error
+    MOV     r1.w0, r2.w0
+    QBBC    SDC_ERR_ABS, r2, 31
+    RSB     r1.w0, r1.w0, 0
+SDC_ERR_ABS:
+
+    ; r0.b1 = direction a correction step has to go (bit 7 set = negative),
+    ; a negative scale means the encoder counts down for positive steps
+    XOR     r0.b1, r2.b3, (CLoop.CountsPerStep).b3
+
+    ; r1.b2 = 1 if a correction step is wanted (Deadband < |error| <= MaxError)
+    ; Beyond MaxError we assume a stall or a broken encoder and stop correcting
+    LDI     r1.b2, 0
+    QBGE    SDC_CORR_CHK_DONE, r1.w0, CLoop.Deadband
+    QBLT    SDC_CORR_CHK_DONE, r1.w0, CLoop.MaxError
+    LDI     r1.b2, 1
+SDC_CORR_CHK_DONE:
+
+    ; r1.b3 = wanted direction (bit 7 set = negative)
+    ; Follow the commanded rate.  When stopped keep the current direction,
+    ; unless a correction step has to go the other way
+    MOV     r1.b3, (State.Rate).b3
+    QBNE    SDC_DIR_SEL_DONE, State.Rate, 0
+    MOV     r1.b3, State.RateQ
+    QBEQ    SDC_DIR_SEL_DONE, r1.b2, 0
+    QBBS    SDC_DIR_SEL_DONE, State.Accum, StepBit
+    MOV     r1.b3, r0.b1
+SDC_DIR_SEL_DONE:
+
+    ; Check if direction changed
+    XOR     r0.b0, r1.b3, State.RateQ
+    MOV     State.RateQ, r1.b3
+    QBBC    SDC_DIR_CHG_DONE, r0.b0, 7
+
+    ; Flag direction change
+    SET     State.Accum, State.Accum, DirChgBit
+
+SDC_DIR_CHG_DONE:
+
+    ; Update the pulse timings, if required
+    QBBC    SDC_PULSE_DONE, State.Accum, PulseHoldBit
+
+    ; Decrement timeout
+    SUB     State.T_Pulse, State.T_Pulse, 1
+    QBNE    SDC_PULSE_DONE, State.T_Pulse, 0
+
+    ; Pulse timer expired
+
+    ; Check to see if step output is active
+    QBEQ    SDC_PULSE_DELAY_OVER, State.StepQ, 0
+
+    ; Step pulse output is active, clear it and setup pulse low delay
+    MOV     r3.b1, GTask.dataX
+    MOV     r3.b0, State.StepInvert
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    LDI     State.StepQ, 0
+    MOV     State.T_Pulse, State.Dly_step_space
+    JMP     SDC_PULSE_DONE
+
+SDC_PULSE_DELAY_OVER:
+
+    ; Step pulse output is low and pulse low timer expired,
+    ; so clear Pulse Hold bit in accumulator and we're done
+    CLR     State.Accum, State.Accum, PulseHoldBit
+
+SDC_PULSE_DONE:
+
+    ; Decrement Direction timer if non-zero
+    QBEQ    SDC_DIR_SKIP_SUB, State.T_Dir, 0
+    SUB     State.T_Dir, State.T_Dir, 1
+
+SDC_DIR_SKIP_SUB:
+
+    ; Process direction updates if required (either DirHoldBit or DirChgBit is set)
+    QBGE    SDC_DIR_DONE, (State.Accum).b3, DirHoldMask
+
+    ; Wait for any pending timeout
+    QBNE    SDC_DIR_DONE, State.T_Dir, 0
+
+    ; Direction timer expired
+
+    QBBC    SDC_DIR_SETUP_DLY, State.Accum, DirChgBit
+
+    ; Dir Changed bit is set, we need to update Dir output and configure dir setup timer
+
+    ; Update Direction output from the wanted direction, not the rate
+    MOV     r3.b1, GTask.dataY
+    LSR     r3.b0, State.RateQ, 7
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Clear Dir Changed Bit
+    CLR     State.Accum, State.Accum, DirChgBit
+    SET     State.Accum, State.Accum, DirHoldBit
+    MOV     State.T_Pulse, State.Dly_dir_setup
+    JMP     SDC_DIR_DONE
+
+SDC_DIR_SETUP_DLY:
+    CLR     State.Accum, State.Accum, DirHoldBit
+
+SDC_DIR_DONE:
+
+    QBBC    SDC_CORRECT, State.Accum, StepBit
+    QBLT    SDC_STEP_DONE, (State.Accum).b3, HoldMask
+
+    ; Time for a commanded step!
+
+    ; Reset Accumulator status bits
+    CLR     State.Accum, State.Accum, StepBit
+    OR      (State.Accum).b3, (State.Accum).b3, 0x30    ; Set GuardBit and PulseHoldBit
+
+    ; Update position register and the expected encoder position
+    ; in the direction the output is actually pointing
+    QBBS    SDC_POS_DOWN, State.RateQ, 7
+    ADD     State.Pos, State.Pos, 1
+    ADD     CLoop.Expected, CLoop.Expected, CLoop.CountsPerStep
+    JMP     SDC_STEP_OUT
+SDC_POS_DOWN:
+    SUB     State.Pos, State.Pos, 1
+    SUB     CLoop.Expected, CLoop.Expected, CLoop.CountsPerStep
+    JMP     SDC_STEP_OUT
+
+SDC_CORRECT:
+
+    ; No commanded step pending, inject a correction step if one is wanted,
+    ; no hold is active and the direction output points the right way.
+    ; Correction steps do not touch Pos or Expected, so the position feedback
+    ; seen by the driver still matches the commanded position.
+    QBEQ    SDC_STEP_DONE, r1.b2, 0
+    QBLT    SDC_STEP_DONE, (State.Accum).b3, HoldMask
+    XOR     r0.b0, r0.b1, State.RateQ
+    QBBS    SDC_STEP_DONE, r0.b0, 7
+
+    SET     State.Accum, State.Accum, PulseHoldBit
+    ADD     CLoop.Corrections, CLoop.Corrections, 1
+
+SDC_STEP_OUT:
+    ; Update state
+    MOV     r3.b1, GTask.dataX
+    XOR     r3.b0, State.StepInvert, 1
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    SET     State.StepQ, State.StepQ, 0
+    MOV     State.T_Pulse, State.Delays
+
+SDC_STEP_DONE:
+    ; Save channel state data
+    SBBO    &State.Accum, GTask.addr, $sizeof(task_header) + stepdir_state.Accum - stepdir_state.Rate, $sizeof(State) - $sizeof(State.StepInvert) - $sizeof(State.Reserved1) - stepdir_state.Accum + stepdir_state.Rate
+
+    ; Save closed loop state data and the following error for the driver
+    SBBO    &CLoop.Expected, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state) + stepcl_state.Expected - stepcl_state.EncAddr, $sizeof(CLoop.Expected) + $sizeof(CLoop.Corrections)
+    SBBO    &r2, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state) + $sizeof(stepcl_state), 4
+
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
@@ -0,0 +1,328 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_stepgear.asm                                        //
+;// PRU code implementing a step/dir generator geared to an encoder      //
+;//                                                                      //
+;// Author(s): Charles Steinkuehler                                      //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Derived from step/dir, step output geared to an          //
+;//             encoder                                                  //
+;// 2013-May    Charles Steinkuehler                                     //
+;//             Split into several files                                 //
+;//             Altered main loop to support a linked list of tasks      //
+;//             Added support for GPIO pins in addition to PRU outputs   //
+;// 2012-Dec-27 Charles Steinkuehler                                     //
+;//             Initial version                                          //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2013  Charles Steinkuehler                             //
+;//                     <charles AT steinkuehler DOT net>                //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState .sassign r0, global_state
+
+Gear .sassign r4, stepgear_state ; gearing state, only live until the step generator state is loaded
+
+State .sassign r4, stepdir_state ; r4 is assigned to GState.State_Reg0
+
+GTask .sassign r12, task_header
+
+    .define 31, DirHoldBit      
+    .define 30, DirChgBit       
+    .define 29, PulseHoldBit    
+    .define 28, GuardBit        
+    .define 27, StepBit         
+
+    .define 0x1F, HoldMask        
+    .define 0x3F, DirHoldMask     
+
+    .text
+    
+    .def MODE_STEP_GEAR
+
+    .ref NEXT_TASK
+    .ref SET_CLR_BIT
+
+    ; Step/dir generator slaved to an encoder channel.  While the gearing is
+    ; engaged (bit 0 of Flags) every encoder count moves the gear
+    ; target by Ratio steps, and the step output follows the target at the
+    ; PRU tick rate.  The ratio in use ramps towards the wanted one by
+    ; BlendStep per tick, so engaging the gear does not jump the step rate.
+    ; When disengaged this is a plain step/dir generator running at Rate.
+    ;
+    ; The sync error (gear target - step position, signed 16.16 steps) is
+    ; kept in r11 and the flags in r0.b3 between the two halves of the task.
+
+MODE_STEP_GEAR:
+
+    ; Read in gearing state data
+    LBBO    &Gear, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state), $sizeof(Gear)
+
+    ; Read the low 16 bits of the linked encoder count, plenty for one tick
+    MOV     r3, Gear.EncAddr
+    LBBO    &r1.w0, r3, 0, 2
+
+    MOV     r0.b3, Gear.Flags
+    QBBS    SG_GEAR_ON, r0.b3, STEPGEAR_ENABLE_BIT
+
+    ; Disengaged, track the encoder and restart the ramp from a zero ratio
+    MOV     Gear.EncLast, r1.w0
+    LDI     Gear.EffRatio, 0
+    LDI     Gear.Error, 0
+    JMP     SG_GEAR_DONE
+
+SG_GEAR_ON:
+
+    ; Ramp the ratio in use towards the wanted ratio
+    QBEQ    SG_RAMP_DONE, Gear.EffRatio, Gear.Ratio
+    SUB     r2, Gear.Ratio, Gear.EffRatio
+    QBBS    SG_RAMP_DOWN, r2, 31
+    QBGE    SG_RAMP_SET, r2, Gear.BlendStep
+    ADD     Gear.EffRatio, Gear.EffRatio, Gear.BlendStep
+    JMP     SG_RAMP_DONE
+SG_RAMP_DOWN:
+    RSB     r2, r2, 0
+    QBGE    SG_RAMP_SET, r2, Gear.BlendStep
+    SUB     Gear.EffRatio, Gear.EffRatio, Gear.BlendStep
+    JMP     SG_RAMP_DONE
+SG_RAMP_SET:
+    MOV     Gear.EffRatio, Gear.Ratio
+SG_RAMP_DONE:
+
+    ; Encoder counts since the last tick, sign extended to 32 bits
+    SUB     r2.w0, r1.w0, Gear.EncLast
+    MOV     Gear.EncLast, r1.w0
+    LDI     r2.w2, 0
+    QBBC    SG_DELTA_POS, r2, 15
+    LDI     r2.w2, 0xFFFF
+SG_DELTA_POS:
+    QBEQ    SG_GEAR_DONE, r2, 0
+
+    ; r1.b0 bit 7 = sign of the target change
+    XOR     r1.b0, r2.b3, (Gear.EffRatio).b3
+
+    ; |counts| * |ratio| with the multiplier, the low 32 bits of the product
+    ; are the target change in 16.16 steps
+    LDI     GState.Mul_Status, 0                ; multiply only mode
+    XOUT    0, &GState.Mul_Status, 1
+    QBBC    SG_DELTA_ABS, r2, 31
+    RSB     r2, r2, 0
+SG_DELTA_ABS:
+    MOV     r3, Gear.EffRatio
+    QBBC    SG_RATIO_ABS, r3, 31
+    RSB     r3, r3, 0
+SG_RATIO_ABS:
+    MOV     GState.Mul_Op1, r2
+    MOV     GState.Mul_Op2, r3
+    NOP                                         ; the product follows the operands one cycle later
+    XIN     0, &GState.Mul_Prod_L, 4
+
+    QBBS    SG_TARGET_DOWN, r1.b0, 7
+    ADD     Gear.Error, Gear.Error, GState.Mul_Prod_L
+    JMP     SG_GEAR_DONE
+SG_TARGET_DOWN:
+    SUB     Gear.Error, Gear.Error, GState.Mul_Prod_L
+
+SG_GEAR_DONE:
+
+    ; Save the PRU owned gearing state, the error is saved with the step state
+    SBBO    &Gear.EffRatio, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state) + stepgear_state.EffRatio - stepgear_state.EncAddr, $sizeof(Gear.EffRatio) + $sizeof(Gear.EncLast) + $sizeof(Gear.Reserved)
+    MOV     r11, Gear.Error
+
+    ; Read in task state data
+    LBBO    &State, GTask.addr, $sizeof(task_header), $sizeof(State)
+
+    ; Accumulator MSBs are used for state/status encoding, see pru_stepdir.asm
+
+    ; r0.b1 = direction a gear step has to go (bit 7 set = negative)
+    ; r0.b2 = 1 if a gear step is wanted, the target is rounded to the nearest step
+    MOV     r0.b1, r11.b3
+    LDI     r0.b2, 0
+    MOV     r2, r11
+    QBBC    SG_ERR_ABS, r2, 31
+    RSB     r2, r2, 0
+SG_ERR_ABS:
+    LDI     r3, 0x8000
+    QBGT    SG_WANT_DONE, r2, r3
+    LDI     r0.b2, 1
+SG_WANT_DONE:
+
+    ; r1.b3 = wanted direction (bit 7 set = negative)
+    QBBS    SG_GEAR_DIR, r0.b3, STEPGEAR_ENABLE_BIT
+
+    ; Disengaged, accumulate the commanded rate like MODE_STEP_DIR
+    MOV     r1.b3, (State.Rate).b3
+    QBBS    SG_DIR_SEL_DONE, State.Accum, StepBit
+    ADD     State.Accum, State.Accum, State.Rate
+    JMP     SG_DIR_SEL_DONE
+
+SG_GEAR_DIR:
+    ; Engaged, the commanded rate is ignored.  When no gear step is wanted
+    ; keep the current direction
+    MOV     r1.b3, State.RateQ
+    QBEQ    SG_DIR_SEL_DONE, r0.b2, 0
+    QBBS    SG_DIR_SEL_DONE, State.Accum, StepBit
+    MOV     r1.b3, r0.b1
+
+SG_DIR_SEL_DONE:
+
+    ; Check if direction changed
+    XOR     r0.b0, r1.b3, State.RateQ
+    MOV     State.RateQ, r1.b3
+    QBBC    SG_DIR_CHG_DONE, r0.b0, 7
+
+    ; Flag direction change
+    SET     State.Accum, State.Accum, DirChgBit
+
+SG_DIR_CHG_DONE:
+
+    ; Update the pulse timings, if required
+    QBBC    SG_PULSE_DONE, State.Accum, PulseHoldBit
+
+    ; Decrement timeout
+    SUB     State.T_Pulse, State.T_Pulse, 1
+    QBNE    SG_PULSE_DONE, State.T_Pulse, 0
+
+    ; Pulse timer expired
+
+    ; Check to see if step output is active
+    QBEQ    SG_PULSE_DELAY_OVER, State.StepQ, 0
+
+    ; Step pulse output is active, clear it and setup pulse low delay
+    MOV     r3.b1, GTask.dataX
+    MOV     r3.b0, State.StepInvert
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    LDI     State.StepQ, 0
+    MOV     State.T_Pulse, State.Dly_step_space
+    JMP     SG_PULSE_DONE
+
+SG_PULSE_DELAY_OVER:
+
+    ; Step pulse output is low and pulse low timer expired,
+    ; so clear Pulse Hold bit in accumulator and we're done
+    CLR     State.Accum, State.Accum, PulseHoldBit
+
+SG_PULSE_DONE:
+
+    ; Decrement Direction timer if non-zero
+    QBEQ    SG_DIR_SKIP_SUB, State.T_Dir, 0
+    SUB     State.T_Dir, State.T_Dir, 1
+
+SG_DIR_SKIP_SUB:
+
+    ; Process direction updates if required (either DirHoldBit or DirChgBit is set)
+    QBGE    SG_DIR_DONE, (State.Accum).b3, DirHoldMask
+
+    ; Wait for any pending timeout
+    QBNE    SG_DIR_DONE, State.T_Dir, 0
+
+    ; Direction timer expired
+
+    QBBC    SG_DIR_SETUP_DLY, State.Accum, DirChgBit
+
+    ; Dir Changed bit is set, we need to update Dir output and configure dir setup timer
+
+    ; Update Direction output from the wanted direction, not the rate
+    MOV     r3.b1, GTask.dataY
+    LSR     r3.b0, State.RateQ, 7
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Clear Dir Changed Bit
+    CLR     State.Accum, State.Accum, DirChgBit
+    SET     State.Accum, State.Accum, DirHoldBit
+    MOV     State.T_Pulse, State.Dly_dir_setup
+    JMP     SG_DIR_DONE
+
+SG_DIR_SETUP_DLY:
+    CLR     State.Accum, State.Accum, DirHoldBit
+
+SG_DIR_DONE:
+
+    QBBC    SG_GEAR_STEP, State.Accum, StepBit
+    QBLT    SG_STEP_DONE, (State.Accum).b3, HoldMask
+
+    ; Time for a commanded step!
+
+    ; Reset Accumulator status bits
+    CLR     State.Accum, State.Accum, StepBit
+    OR      (State.Accum).b3, (State.Accum).b3, 0x30    ; Set GuardBit and PulseHoldBit
+    JMP     SG_STEP_POS
+
+SG_GEAR_STEP:
+
+    ; No commanded step pending, issue a gear step if one is wanted, no hold
+    ; is active and the direction output points the right way
+    QBEQ    SG_STEP_DONE, r0.b2, 0
+    QBLT    SG_STEP_DONE, (State.Accum).b3, HoldMask
+    XOR     r0.b0, r0.b1, State.RateQ
+    QBBS    SG_STEP_DONE, r0.b0, 7
+
+    SET     State.Accum, State.Accum, PulseHoldBit
+
+SG_STEP_POS:
+    ; Update position register and the sync error in the direction the
+    ; output is actually pointing (the error is reset while disengaged)
+    QBBS    SG_POS_DOWN, State.RateQ, 7
+    ADD     State.Pos, State.Pos, 1
+    SUB     r11.w2, r11.w2, 1
+    JMP     SG_STEP_OUT
+SG_POS_DOWN:
+    SUB     State.Pos, State.Pos, 1
+    ADD     r11.w2, r11.w2, 1
+
+SG_STEP_OUT:
+    ; Update state
+    MOV     r3.b1, GTask.dataX
+    XOR     r3.b0, State.StepInvert, 1
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    SET     State.StepQ, State.StepQ, 0
+    MOV     State.T_Pulse, State.Delays
+
+SG_STEP_DONE:
+    ; Save channel state data
+    SBBO    &State.Accum, GTask.addr, $sizeof(task_header) + stepdir_state.Accum - stepdir_state.Rate, $sizeof(State) - $sizeof(State.StepInvert) - $sizeof(State.Reserved1) - stepdir_state.Accum + stepdir_state.Rate
+
+    ; Save the sync error for the driver, commanded steps do not count
+    ; while disengaged
+    QBBS    SG_SAVE_ERR, r0.b3, STEPGEAR_ENABLE_BIT
+    LDI     r11, 0
+SG_SAVE_ERR:
+    SBBO    &r11, GTask.addr, $sizeof(task_header) + $sizeof(stepdir_state) + stepgear_state.Error - stepgear_state.EncAddr, 4
+
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
@@ -0,0 +1,143 @@
+;//----------------------------------------------------------------------//
+;// Description: pru_stepmicro.asm                                       //
+;// PRU code implementing sine/cosine microstepping for two phase motors //
+;//                                                                      //
+;// Author(s): Thomas Gerner                                             //
+;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+;//                                                                      //
+;// Major Changes:                                                       //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Initial version, derived from step/phase                 //
+;//----------------------------------------------------------------------//
+;// This file is part of LinuxCNC HAL                                    //
+;//                                                                      //
+;// Copyright (C) 2013  Charles Steinkuehler                             //
+;//                     <charles AT steinkuehler DOT net>                //
+;//                                                                      //
+;// This program is free software; you can redistribute it and/or        //
+;// modify it under the terms of the GNU General Public License          //
+;// as published by the Free Software Foundation; either version 2       //
+;// of the License, or (at your option) any later version.               //
+;//                                                                      //
+;// This program is distributed in the hope that it will be useful,      //
+;// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+;// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+;// GNU General Public License for more details.                         //
+;//                                                                      //
+;// You should have received a copy of the GNU General Public License    //
+;// along with this program; if not, write to the Free Software          //
+;// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+;// 02110-1301, USA.                                                     //
+;//                                                                      //
+;// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+;// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+;// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+;// harming persons must have provisions for completely removing power   //
+;// from all motors, etc, before persons enter any danger area.  All     //
+;// machinery must be designed to comply with local and national safety  //
+;// codes, and the authors of this software can not, and do not, take    //
+;// any responsibility for such compliance.                              //
+;//                                                                      //
+;// This code was written as part of the LinuxCNC project.  For more     //
+;// information, go to www.linuxcnc.org.                                 //
+;//----------------------------------------------------------------------//
+
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+State   .sassign r4, microstep_state    ; r4 is assigned to GState.State_Reg0
+
+GTask   .sassign r12, task_header
+
+    .define 28, MsGuardBit
+    .define 27, MsStepBit
+
+    .text
+    
+    .ref NEXT_TASK
+    .ref SET_CLR_BIT
+
+    .def MODE_STEP_MICRO
+MODE_STEP_MICRO:
+    ; Read in task state data
+    LBBO    &State, GTask.addr, $sizeof(task_header), $sizeof(microstep_state)
+
+    ; The DDS works like the other step generators, but there is no step
+    ; timing to honor: Pos counts full steps and the 27 accumulator bits below
+    ; the step bit are the position between two full steps.  Bits above the
+    ; guard bit carry no status here and are simply masked off, which keeps
+    ; the arithmetic modulo 2^29 for both directions.
+    ADD     State.Accum, State.Accum, State.Rate
+    AND     (State.Accum).b3, (State.Accum).b3, 0x1F
+
+    QBBC    SMS_NO_STEP, State.Accum, MsStepBit
+    CLR     State.Accum, State.Accum, MsStepBit
+    SET     State.Accum, State.Accum, MsGuardBit
+
+    ADD     State.Pos, State.Pos, 1
+    QBBC    SMS_NO_STEP, State.Rate, 31
+    SUB     State.Pos, State.Pos, 2
+
+SMS_NO_STEP:
+
+    ; Electrical angle as 8-bit sine table index:
+    ; Pos1 Pos0 F26 F25 F24 F23 F22 F21
+    ; Four full steps are one electrical cycle, the fraction supplies 64
+    ; microsteps per full step and the mask drops the unused low bits
+    LSR     r2, State.Accum, 21
+    AND     r2.b0, r2.b0, 0x3F
+    LSL     r2.b1, State.Pos, 6
+    OR      r2.b0, r2.b0, r2.b1
+    AND     r2.b0, r2.b0, State.Mask
+
+    ; Phase A uses sin(angle), phase B cos(angle) = sin(angle + 90 deg)
+    ; Table entries are 0x0000 to 0x4000 magnitude, bit 15 set for negative
+    LSL     r1.w0, r2.b0, 1
+    ADD     r2.b1, r2.b0, 64
+    LSL     r1.w2, r2.b1, 1
+    LBBO    &r0.w0, State.Table, r1.w0, 2
+    LBBO    &r0.w2, State.Table, r1.w2, 2
+
+    ; Phase A polarity
+    LSR     r3.b0, r0.w0, 15
+    MOV     r3.b1, State.PinC
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Phase A magnitude, first order delta-sigma
+    ; Integrator stays below 0x4000, so a full scale value outputs 1 every period
+    CLR     r0.w0, r0.w0, 15
+    ADD     State.IntA, State.IntA, r0.w0
+    LDI     r3.b0, 0
+    QBBC    SMS_A_OUT, State.IntA, 14
+    CLR     State.IntA, State.IntA, 14
+    LDI     r3.b0, 1
+SMS_A_OUT:
+    MOV     r3.b1, GTask.dataX
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Phase B polarity
+    LSR     r3.b0, r0.w2, 15
+    MOV     r3.b1, State.PinD
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Phase B magnitude
+    CLR     r0.w2, r0.w2, 15
+    ADD     State.IntB, State.IntB, r0.w2
+    LDI     r3.b0, 0
+    QBBC    SMS_B_OUT, State.IntB, 14
+    CLR     State.IntB, State.IntB, 14
+    LDI     r3.b0, 1
+SMS_B_OUT:
+    MOV     r3.b1, GTask.dataY
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+
+    ; Save channel state data: Accum, Pos and the integrators
+    SBBO    &State.Accum, GTask.addr, $sizeof(task_header) + microstep_state.Accum - microstep_state.Rate, 12
+
+    ; We're done here...carry on with the next task
+    JMP     NEXT_TASK
+
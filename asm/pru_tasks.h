@@ -65,7 +65,21 @@
 
 PRU_DATA_START: .set 0
     
-// pru_task_mode_t
+// pru_task_mode_t, only the modes referenced by other tasks
+
+eMODE_WRITE:        .set 2
+eMODE_STEP_DIR:     .set 4
+eMODE_UP_DOWN:      .set 5
+eMODE_DELTA_SIG:    .set 6
+eMODE_PWM:          .set 7
+eMODE_ENCODER:      .set 8
+eMODE_STEP_PHASE:   .set 9
+eMODE_EDGESTEP_DIR: .set 10
+eMODE_STEP_DIR_CL:  .set 11
+eMODE_STEP_MICRO:   .set 12
+eMODE_ENCODER_PAR:  .set 13
+eMODE_STEP_GEAR:    .set 15
+eMODE_PSO:          .set 16
 
 #else
 
@@ -78,15 +92,21 @@ PRU_DATA_START: .set 0
         eMODE_INVALID      = -1,
         eMODE_NONE         = 0,
         eMODE_WAIT         = 1,
-        eMODE_WRITE        = 2,    // Not implemented yet!
-        eMODE_READ         = 3,    // Not implemented yet!
+        eMODE_WRITE        = 2,
+        eMODE_READ         = 3,
         eMODE_STEP_DIR     = 4,
-        eMODE_UP_DOWN      = 5,    // Not implemented yet!
+        eMODE_UP_DOWN      = 5,
         eMODE_DELTA_SIG    = 6,
         eMODE_PWM          = 7,
         eMODE_ENCODER      = 8,
         eMODE_STEP_PHASE   = 9,
-				eMODE_EDGESTEP_DIR = 10
+				eMODE_EDGESTEP_DIR = 10,
+        eMODE_STEP_DIR_CL  = 11,
+        eMODE_STEP_MICRO   = 12,
+        eMODE_ENCODER_PAR  = 13,
+        eMODE_FREQ         = 14,
+        eMODE_STEP_GEAR    = 15,
+        eMODE_PSO          = 16
     } pru_task_mode_t;
 #endif
 
@@ -136,11 +156,19 @@ PRU_DATA_START: .set 0
                 .tag task_hdr
         addr    .int
         period  .int
+        time    .int            // Free running nS time base, advanced every tick by the wait task
+        gpio0_in .int           // GPIO0-3 DATAIN, read by the wait task at the start of every tick
+        gpio1_in .int           // (only the banks used by input pins)
+        gpio2_in .int
+        gpio3_in .int
     .endstruct
 #else
     typedef struct {
         PRU_task_header_t task;
         rtapi_u32     period;
+        rtapi_u32     time;           // Free running nS time base, advanced every tick by the wait task
+        rtapi_u32     gpio_in[4];     // GPIO0-3 DATAIN, read by the wait task at the start of every tick
+                                      // (only the banks used by input pins)
     } PRU_statics_t;
 #endif
 
@@ -212,6 +240,57 @@ PRU_DATA_START: .set 0
                         .tag stepgen_times
         Lut             .int
     .endstruct
+
+    microstep_misc .struct
+        PinC            .byte   // Phase A polarity pin
+        PinD            .byte   // Phase B polarity pin
+        Mask            .byte   // Sine table index mask, sets microstep resolution
+        Reserved1       .byte
+    .endstruct
+
+    microstep_integ .struct
+        IntA            .short  // Phase A delta-sigma integrator
+        IntB            .short  // Phase B delta-sigma integrator
+    .endstruct
+
+    microstep_state .struct
+        Rate            .int
+                        .tag stepdir_len
+                        .tag microstep_misc
+        Accum           .int
+        Pos             .int
+                        .tag microstep_integ
+        Table           .int    // Address of the 256 entry sine table
+    .endstruct
+
+    // Closed loop extension, follows stepdir_state in PRU memory
+    stepcl_state .struct
+        EncAddr         .short  // Address of the linked encoder count
+        Flags           .byte   // bit 0 = closed loop enabled
+        Reserved        .byte
+        Deadband        .short  // Following error (counts) ignored
+        MaxError        .short  // Following error (counts) beyond which correction stops
+        CountsPerStep   .int    // Encoder counts per step, signed 16.16
+        Expected        .int    // Expected encoder count, signed 16.16
+        Corrections     .int    // Number of correction steps issued
+    .endstruct
+    // ...followed by the following error (counts, signed 32-bit) written by the PRU
+
+    // Gearing extension, follows stepdir_state in PRU memory
+    stepgear_state .struct
+        EncAddr         .short  // Address of the linked encoder count
+        Flags           .byte   // bit 0 = gearing engaged
+        Reserved1       .byte
+        Ratio           .int    // Steps per encoder count, signed 16.16
+        BlendStep       .int    // Change of EffRatio per tick while ramping, 16.16
+        EffRatio        .int    // Ratio in use, ramps towards Ratio, signed 16.16
+        EncLast         .short  // Low 16 bits of the encoder count of the last tick
+        Reserved        .short
+        Error           .int    // Gear target - step position, signed 16.16 steps
+    .endstruct
+
+STEPCL_ENABLE_BIT:   .set 0
+STEPGEAR_ENABLE_BIT: .set 0
 #else
     typedef struct  {
         PRU_task_header_t task;
@@ -229,12 +308,16 @@ PRU_DATA_START: .set 0
         union {
             rtapi_u16     dirsetup;
             rtapi_u16     reserved0;
+            struct  {
+                rtapi_u8      mask;
+                rtapi_u8      resvd;
+            } micro;
         };
         rtapi_u32     accum;
         rtapi_u32     pos;
-        rtapi_u32     reserved1;
+        rtapi_u32     reserved1;      // Phase A/B integrators in microstep mode
         union {
-          rtapi_u32     lut;
+          rtapi_u32     lut;            // Phase pattern, or sine table address in microstep mode
           struct {
             rtapi_u16     resvd2;
             rtapi_u8      resvd3;
@@ -242,6 +325,35 @@ PRU_DATA_START: .set 0
           } step;
         };
     } PRU_task_stepgen_t;
+
+    // Closed loop extension, follows PRU_task_stepgen_t in PRU memory
+    typedef struct {
+        rtapi_u16     enc_addr;
+        rtapi_u8      flags;          // PRU_STEPCL_ENABLE
+        rtapi_u8      reserved;
+        rtapi_u16     deadband;
+        rtapi_u16     max_error;
+        rtapi_s32     counts_per_step;
+        rtapi_s32     expected;
+        rtapi_u32     corrections;
+        rtapi_s32     ferror;
+    } PRU_stepgen_cl_t;
+
+    // Gearing extension, follows PRU_task_stepgen_t in PRU memory
+    typedef struct {
+        rtapi_u16     enc_addr;
+        rtapi_u8      flags;          // PRU_STEPGEAR_ENABLE
+        rtapi_u8      reserved1;
+        rtapi_s32     ratio;
+        rtapi_u32     blend_step;
+        rtapi_s32     eff_ratio;      // written by the PRU
+        rtapi_u16     enc_last;       // written by the PRU
+        rtapi_u16     reserved;
+        rtapi_s32     error;          // written by the PRU
+    } PRU_stepgen_gear_t;
+
+    #define PRU_STEPCL_ENABLE   0x01
+    #define PRU_STEPGEAR_ENABLE 0x01
 #endif
 
 //
@@ -257,11 +369,13 @@ PRU_DATA_START: .set 0
     delta_output .struct
         Value       .short           // WARNING: Range is 14-bits: 0x0000 to 0x4000 inclusive!
         Pin         .byte
-        Reserved    .byte
-        Integrate   .short
-        Quantize    .short
+        Mode        .byte           // bit 0 = second order modulator
+        Integrate   .short          // First order: always below 0x4000, second order: signed
+        Integrate2  .short          // Second order only, signed
     .endstruct
 
+DELTA_SECOND_ORDER_BIT: .set 0
+
     delta_state .struct 
         Reserved    .int
     .endstruct
@@ -269,10 +383,12 @@ PRU_DATA_START: .set 0
     typedef struct {
         rtapi_u16     value;          // WARNING: Range is 14-bits: 0x0000 to 0x4000 inclusive!
         rtapi_u8      pin;
-        rtapi_u8      reserved;
+        rtapi_u8      mode;
         rtapi_u32     state;
     } PRU_delta_output_t;
 
+    #define DELTA_MODE_SECOND_ORDER 0x01
+
     typedef struct {
         PRU_task_header_t task;
 
@@ -300,9 +416,15 @@ PRU_DATA_START: .set 0
     pwm_state .struct 
         Prescale    .short
         Period      .short
+        Table       .short          // Offset of the output table the driver wants used
+        Reserved    .short
         T_Prescale  .short
         T_Period    .short
+        Active      .short          // Offset of the output table in use this period
+        Next        .short          // Offset of the next output to clear
     .endstruct
+
+PWM_TABLE_END: .set 0xFFFF
 #else
     typedef struct {
         rtapi_u16     value;
@@ -315,9 +437,19 @@ PRU_DATA_START: .set 0
 
         rtapi_u16     prescale;
         rtapi_u16     period;
-        rtapi_u32     reserved;
-    //  PRU_pwm_output_t out[task.len];
+        rtapi_u16     table;
+        rtapi_u16     reserved;
+        rtapi_u16     t_prescale;
+        rtapi_u16     t_period;
+        rtapi_u16     active;
+        rtapi_u16     next;
+    //  Two output tables, each sorted by value and ended by an entry with
+    //  value PWM_TABLE_END.  The PRU switches to the table given by
+    //  "table" when the period wraps.
+    //  PRU_pwm_output_t out[2][task.len + 1];
     } PRU_task_pwm_t;
+
+    #define PWM_TABLE_END 0xFFFF
 #endif
 
 //
@@ -326,51 +458,89 @@ PRU_DATA_START: .set 0
 
 #ifndef _hal_pru_generic_H_
     encoder_index .struct 
-        wraddr      .int          // Task address + sizeof(read-only objects in encoder_chan)
-        Offset      .short
-        Reserved    .short
+        Offset      .short        // Offset of the current channel from the task address
+        WrOffset    .short        // Offset of the first writable byte of the current channel
     .endstruct
 
     encoder_chan .struct 
         A_pin       .byte
         B_pin       .byte
         Z_pin       .byte           // Index
-        mode        .byte
+        mode        .byte           // bits 0-1 = counter mode, bit 2 = index-enable armed, bits 4-7 = filter
 
         AB_State    .byte
         AB_scratch  .byte
-        count       .short
-
-        Z_capture   .short
         Z_count     .byte         // Used by driver to compute "index seen"
-        Z_State     .byte
+        Z_State     .byte         // bit 0 = Z of the last pass, bit 1 = index captured while armed
+
+        count       .int
 
+        Z_capture   .int
+
+        Timestamp   .int          // Time of the last count change, see pru_statics.time
+    .endstruct
+
+    // Input filter state, follows each encoder_chan in PRU memory
+    encoder_filt .struct
+        FiltA       .byte         // bit 7 = filtered level, bits 0-6 = integrator
+        FiltB       .byte
+        FiltZ       .byte
+        QErr        .byte         // Quadrature error count, wraps at 256
     .endstruct
 
+    // Input pin numbers: 0-31 = PRU input r31, 32-159 = GPIO0-3 (32 pins each)
     encoder_state .struct 
         pins    .int            // XOR mask to invert all input pins in one instruction
         LUT     .int            // Base address of LUT for counter modes
     .endstruct
+
+    // GPIO input inversion, follows encoder_state
+    encoder_gpio .struct
+        Gpio0   .int            // XOR masks for the GPIO0-3 input pins
+        Gpio1   .int
+        Gpio2   .int
+        Gpio3   .int
+    .endstruct
+
+    // Bit-parallel encoder state, encoder_state.LUT points here
+    encoder_par .struct
+        AMask   .int            // A input bits of all channels
+        Prev    .int            // Input pins of the previous pass
+        Bank    .byte           // Input word of all pins: 0 = r31, 1-4 = GPIO0-3
+        Reserved1 .byte
+        Reserved2 .short
+        Arm     .int            // A input bits of the channels with index-enable set
+        Held    .int            // A input bits of the armed channels that captured an index edge
+    .endstruct
+    // ...followed by a 32 byte map from A input bit to channel number
 #else
     typedef struct {
         rtapi_u8      A_pin;
         rtapi_u8      B_pin;
         rtapi_u8      Z_pin;          // Index
-        rtapi_u8      mode;
+        rtapi_u8      mode;           // bits 0-1 = counter mode, bit 2 = index-enable armed, bits 4-7 = filter
 
         rtapi_u8      AB_State;
         rtapi_u8      AB_scratch;
-        rtapi_u16     count;
-
-        rtapi_u16     Z_capture;
         rtapi_u8      Z_count;        // Used by driver to compute "index seen"
-        rtapi_u8      Z_State;
+        rtapi_u8      Z_State;        // bit 0 = Z of the last pass, bit 1 = index captured while armed
+
+        rtapi_u32     count;
+
+        rtapi_u32     Z_capture;
+
+        rtapi_u32     timestamp;      // Time of the last count change, see PRU_statics_t.time
+
+        rtapi_u8      filt_A;         // Input filter state: bit 7 = filtered level, bits 0-6 = integrator
+        rtapi_u8      filt_B;
+        rtapi_u8      filt_Z;
+        rtapi_u8      qerr;           // Quadrature error count, wraps at 256
     } PRU_encoder_hdr_t;
 
     typedef union {
-        rtapi_u32     dword[3];
-        rtapi_u16     word[6];
-        rtapi_u8      byte[12];
+        rtapi_u32     dword[6];
+        rtapi_u16     word[12];
+        rtapi_u8      byte[24];
     } PRU_encoder_raw_t;
 
     typedef union {
@@ -387,8 +557,176 @@ PRU_DATA_START: .set 0
 
         rtapi_u32     pin_invert;     // XOR mask to invert all input pins in one instruction
         rtapi_u32     LUT;            // Base address of LUT for counter modes
+        rtapi_u32     gpio_invert[4]; // XOR masks for the GPIO0-3 input pins
     //  PRU_encoder_chan_t enc[task.len];
     } PRU_task_encoder_t;
+
+    // Bit-parallel encoder state, PRU_task_encoder_t.LUT points here
+    // The task header dataX holds the distance of the B inputs from the A
+    // inputs, dataY the distance of the index inputs (0 = no index)
+    typedef struct {
+        rtapi_u32     a_mask;         // A input bits of all channels
+        rtapi_u32     prev;           // Input pins of the previous pass, written by the PRU
+        rtapi_u8      bank;           // Input word of all pins: 0 = r31, 1-4 = GPIO0-3
+        rtapi_u8      reserved1;
+        rtapi_u16     reserved2;
+        rtapi_u32     arm;            // A input bits of the channels with index-enable set
+        rtapi_u32     held;           // A input bits of the armed channels that captured an index edge, written by the PRU
+        rtapi_u8      chan[32];       // Channel number for each A input bit
+    } PRU_encoder_par_t;
+#endif
+
+//
+// read task
+//
+
+#ifndef _hal_pru_generic_H_
+    // Input snapshot, written by the PRU every tick
+    read_state .struct
+        Pins    .int            // PRU inputs (r31)
+        Gpio0   .int            // GPIO0-3 DATAIN, as read by the wait task
+        Gpio1   .int
+        Gpio2   .int
+        Gpio3   .int
+    .endstruct
+
+    read_input .struct
+        Pin     .byte           // 0-31 = PRU input, 32-159 = GPIO0-3
+        Filter  .byte           // Debounce: ticks a new level has to be stable, minus one, at most 254
+        Count   .byte           // Ticks the input differs from State
+        State   .byte           // bit 0 = debounced input
+        Edges   .int            // Debounced edges, wraps
+    .endstruct
+#else
+    typedef struct {
+        rtapi_u8      pin;            // 0-31 = PRU input, 32-159 = GPIO0-3
+        rtapi_u8      filter;         // Debounce: ticks a new level has to be stable, minus one, at most 254
+        rtapi_u8      count;          // Ticks the input differs from state, written by the PRU
+        rtapi_u8      state;          // bit 0 = debounced input, written by the PRU
+        rtapi_u32     edges;          // Debounced edges, wraps, written by the PRU
+    } PRU_read_input_t;
+
+    typedef struct {
+        PRU_task_header_t task;
+
+        rtapi_u32     pins;           // Input snapshot of the last tick: PRU inputs (r31)
+        rtapi_u32     gpio[4];        // GPIO0-3 DATAIN
+    //  PRU_read_input_t in[task.len];
+    } PRU_task_read_t;
+#endif
+
+//
+// frequency counter task
+//
+
+#ifndef _hal_pru_generic_H_
+    freq_chan .struct
+        Pin         .byte           // 0-31 = PRU input, 32-159 = GPIO0-3
+        Level       .byte           // Input level of the last tick
+        Reserved    .short
+        Count       .int            // Rising edges, wraps
+        Time        .int            // Time of the last rising edge, see PRU_statics_t.time
+    .endstruct
+#else
+    typedef struct {
+        rtapi_u8      pin;            // 0-31 = PRU input, 32-159 = GPIO0-3
+        rtapi_u8      level;          // Input level of the last tick, written by the PRU
+        rtapi_u16     reserved;
+        rtapi_u32     count;          // Rising edges, wraps, written by the PRU
+        rtapi_u32     time;           // Time of the last rising edge, written by the PRU
+    } PRU_freq_chan_t;
+
+    typedef struct {
+        PRU_task_header_t task;
+    //  PRU_freq_chan_t chan[task.len];
+    } PRU_task_freq_t;
+#endif
+
+//
+// position synchronized output task
+//
+
+#ifndef _hal_pru_generic_H_
+    pso_state .struct
+        SrcAddr     .short          // Address of the watched position, a stepgen Pos or an encoder count
+        Flags       .byte           // bit 0 = compare enabled
+        Reserved    .byte
+        Width       .short          // Pulse length in ticks, 0 = toggle the output at every entry
+        Tail        .byte           // Next table entry the driver fills
+        Invert      .byte           // bit 0 = output inverted
+        Last        .int            // Position of the last tick
+        Fired       .int            // Table entries passed, wraps
+        Timer       .short          // Ticks left of the current pulse
+        Head        .byte           // Next table entry compared
+        Level       .byte           // Output level, before Invert
+    .endstruct
+    // ...followed by PSO_TABLE_SIZE compare positions (signed 32-bit)
+
+PSO_TABLE_SIZE:     .set 32
+PSO_ENABLE_BIT:     .set 0
+#else
+    #define PSO_TABLE_SIZE 32
+    #define PRU_PSO_ENABLE 0x01
+
+    typedef struct {
+        PRU_task_header_t task;
+
+        rtapi_u16     src_addr;       // Address of the watched position, a stepgen Pos or an encoder count
+        rtapi_u8      flags;          // PRU_PSO_ENABLE
+        rtapi_u8      reserved;
+        rtapi_u16     width;          // Pulse length in ticks, 0 = toggle the output at every entry
+        rtapi_u8      tail;           // Next table entry the driver fills
+        rtapi_u8      invert;         // bit 0 = output inverted
+        rtapi_u32     last;           // written by the PRU
+        rtapi_u32     fired;          // Table entries passed, wraps, written by the PRU
+        rtapi_u16     timer;          // written by the PRU
+        rtapi_u8      head;           // Next table entry compared, written by the PRU
+        rtapi_u8      level;          // written by the PRU
+        rtapi_s32     table[PSO_TABLE_SIZE];
+    } PRU_task_pso_t;
+#endif
+
+//
+// write task
+//
+
+#ifndef _hal_pru_generic_H_
+    write_state .struct
+        Gpio0Clr    .int        // GPIO0-3 bits to clear/set at the next tick
+        Gpio0Set    .int
+        Gpio1Clr    .int
+        Gpio1Set    .int
+        Gpio2Clr    .int
+        Gpio2Set    .int
+        Gpio3Clr    .int
+        Gpio3Set    .int
+        PruClr      .int        // PRU output (r30) bits to clear/set
+        PruSet      .int
+        SafeGpio0Clr .int       // Masks replacing the ones above while a fault is latched
+        SafeGpio0Set .int
+        SafeGpio1Clr .int
+        SafeGpio1Set .int
+        SafeGpio2Clr .int
+        SafeGpio2Set .int
+        SafeGpio3Clr .int
+        SafeGpio3Set .int
+        SafePruClr  .int
+        SafePruSet  .int
+    .endstruct
+#else
+    typedef struct {
+        rtapi_u32     clr;
+        rtapi_u32     set;
+    } PRU_write_bank_t;
+
+    typedef struct {
+        PRU_task_header_t task;
+
+        PRU_write_bank_t  gpio[4];    // GPIO0-3 bits to clear/set at the next tick
+        PRU_write_bank_t  pru;        // PRU output (r30) bits to clear/set
+        PRU_write_bank_t  safe_gpio[4]; // Masks replacing the ones above while a fault is latched
+        PRU_write_bank_t  safe_pru;
+    } PRU_task_write_t;
 #endif
 
 //
@@ -396,9 +734,62 @@ PRU_DATA_START: .set 0
 //
 
 #ifndef _hal_pru_generic_H_
+    wait_data .struct
+        Encoder     .int            // Encoder task sampled while waiting for the tick, 0 = none
+        Deadline    .int            // IEP count (nS) after which no further sample is started
+        GpioIn      .byte           // GPIO banks (bit 0-3 = GPIO0-3) to read at the start of every tick
+        Reserved1   .byte
+        Reserved2   .short
+    .endstruct
+
+    // Host watchdog and stop input, follows wait_data in PRU memory
+    wait_watchdog .struct
+        Heartbeat   .int            // Changed by the driver every servo period
+        Seen        .int            // Heartbeat seen last
+        Ticks       .short          // Ticks since the heartbeat changed
+        Timeout     .short          // Ticks without a heartbeat until the watchdog bites, 0 = disabled
+        Fault       .byte           // Latched faults, only written by the PRU
+        Cleared     .byte           // Clear as of the last faults cleared, only written by the PRU
+        StopPin     .byte           // Stop input, 0-31 = PRU input, 32-159 = GPIO0-3
+        StopMode    .byte           // bit 0 = stop input enabled, bit 1 = active low
+        Clear       .byte           // The driver toggles a fault bit here to clear that fault
+        Reserved1   .byte
+        Reserved2   .short
+    .endstruct
 
+FAULT_WATCHDOG_BIT: .set 0
+FAULT_STOP_BIT:     .set 1
+STOP_ENABLE_BIT:    .set 0
+STOP_ACTIVE_LOW_BIT: .set 1
 #else
     typedef struct {
         PRU_task_header_t task;
+
+        rtapi_u32     encoder;        // Encoder task sampled while waiting for the tick, 0 = none
+        rtapi_u32     deadline;       // IEP count (nS) after which no further sample is started
+        rtapi_u8      gpio_in;        // GPIO banks (bit 0-3 = GPIO0-3) to read at the start of every tick
+        rtapi_u8      reserved1;
+        rtapi_u16     reserved2;
     } PRU_task_wait_t;
+
+    // Host watchdog and stop input, follows PRU_task_wait_t in PRU memory
+    typedef struct {
+        rtapi_u32     heartbeat;      // Changed by the driver every servo period
+        rtapi_u32     seen;           // written by the PRU
+        rtapi_u16     ticks;          // written by the PRU
+        rtapi_u16     timeout;        // Ticks without a heartbeat until the watchdog bites, 0 = disabled
+        rtapi_u8      fault;          // written by the PRU, latched faults
+        rtapi_u8      cleared;        // written by the PRU, clear as of the last faults cleared
+        rtapi_u8      stop_pin;       // Stop input, 0-31 = PRU input, 32-159 = GPIO0-3
+        rtapi_u8      stop_mode;
+        rtapi_u8      clear;          // Toggle a fault bit to clear that fault
+        rtapi_u8      reserved1;
+        rtapi_u16     reserved2;
+    } PRU_wait_watchdog_t;
+
+    #define PRU_FAULT_WATCHDOG  0x01
+    #define PRU_FAULT_STOP      0x02
+
+    #define PRU_STOP_ENABLE     0x01
+    #define PRU_STOP_ACTIVE_LOW 0x02
 #endif
@@ -45,19 +45,163 @@
 ;// information, go to www.linuxcnc.org.                                 //
 ;//----------------------------------------------------------------------//
 
+    .include "pru_tasks.inc"
+    
+    .include "pru_global_state.inc"
+    .data
+
+GState .sassign r0, global_state
+
+State .sassign r4, stepdir_state ; r4 is assigned to GState.State_Reg0
+
+GTask .sassign r12, task_header
+
+    .define 31, DirHoldBit      
+    .define 30, DirChgBit       
+    .define 29, PulseHoldBit    
+    .define 28, GuardBit        
+    .define 27, StepBit         
+
+    .define 0x1F, HoldMask        
+    .define 0x3F, DirHoldMask     
+
     .text
     
+    ; Up/Down (CW/CCW) step generation uses the same DDS accumulator and
+    ; timing as step/dir, but pulses dataX for steps up and dataY for steps
+    ; down instead of driving a direction output.  The direction setup and
+    ; hold times still apply, they space the last pulse of one output from
+    ; the first pulse of the other.
+    ;
+    ; StepQ bit 0 is set while a pulse is active, bit 1 tells it is on the
+    ; down output.
+
     .def MODE_UP_DOWN
-    
+
     .ref NEXT_TASK
+    .ref SET_CLR_BIT
 
 MODE_UP_DOWN:
 
-    ; Move along...nothing to see here...
-    ; ...or feel free to write this code!
+    ; Read in task state data
+    LBBO &State, GTask.addr, $sizeof(task_header), $sizeof(State)
+
+    ; Accumulator MSBs are used for state/status encoding:
+    ; t31 = Dir Hold (set if we're waiting for direction setup/hold)
+    ; t30 = Dir Changed (set if rate changed direction and we need to update the direction output)
+    ; t29 = Pulse Hold (set if we're waiting for minimum high/low pulse length)
+    ; t28 = Guard bit (protects higher status bits from accumulator wrapping)
+    ; t27 = Overflow bit (indicates we should generate a step)
+
+    ; If the accumulator overflow bit is set here, we are holding for some reason
+    ; (bits 29-31 should tell us why, but we'll deal with that later)
+    QBBS    UD_ACC_HOLD, State.Accum, StepBit
+    ADD     State.Accum, State.Accum, State.Rate
+UD_ACC_HOLD:
+
+    ; Check if direction changed
+    XOR     r1.b0, (State.Rate).b3, State.RateQ
+    MOV     State.RateQ, (State.Rate).b3
+    QBBC    UD_DIR_CHG_DONE, r1.b0, 7
+
+    ; Flag direction change
+    SET     State.Accum, State.Accum, DirChgBit
+
+UD_DIR_CHG_DONE:
+
+    ; Update the pulse timings, if required
+    QBBC    UD_PULSE_DONE, State.Accum, PulseHoldBit
+
+    ; Decrement timeout
+    SUB     State.T_Pulse, State.T_Pulse, 1
+    QBNE    UD_PULSE_DONE, State.T_Pulse, 0
+
+    ; Pulse timer expired
+
+    ; Check to see if step output is active
+    QBEQ    UD_PULSE_DELAY_OVER, State.StepQ, 0
+
+    ; Step pulse output is active, clear it and setup pulse low delay
+    MOV     r3.b1, GTask.dataX
+    QBBC    UD_CLR_PIN, State.StepQ, 1
+    MOV     r3.b1, GTask.dataY
+UD_CLR_PIN:
+    MOV     r3.b0, State.StepInvert
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    LDI     State.StepQ, 0
+    MOV     State.T_Pulse, State.Dly_step_space
+    JMP     UD_PULSE_DONE
 
-    ; <useful-code-goes-here>
+UD_PULSE_DELAY_OVER:
+
+    ; Step pulse output is low and pulse low timer expired,
+    ; so clear Pulse Hold bit in accumulator and we're done
+    CLR     State.Accum, State.Accum, PulseHoldBit
+
+UD_PULSE_DONE:
+
+    ; Decrement Direction timer if non-zero
+    QBEQ    UD_DIR_SKIP_SUB, State.T_Dir, 0
+    SUB     State.T_Dir, State.T_Dir, 1
+
+UD_DIR_SKIP_SUB:
+
+    ; Process direction updates if required (either DirHoldBit or DirChgBit is set)
+    QBGE    UD_DIR_DONE, (State.Accum).b3, DirHoldMask
+
+    ; Wait for any pending timeout
+    QBNE    UD_DIR_DONE, State.T_Dir, 0
+
+    ; Direction timer expired
+
+    QBBC    UD_DIR_SETUP_DLY, State.Accum, DirChgBit
+
+    ; Dir Changed bit is set, there is no direction output, just configure
+    ; the dir setup timer
+
+    ; Clear Dir Changed Bit
+    CLR     State.Accum, State.Accum, DirChgBit
+    SET     State.Accum, State.Accum, DirHoldBit
+    MOV     State.T_Pulse, State.Dly_dir_setup
+    JMP     UD_DIR_DONE
+
+UD_DIR_SETUP_DLY:
+    CLR     State.Accum, State.Accum, DirHoldBit
+
+UD_DIR_DONE:
+
+    QBBC    UD_STEP_DONE, State.Accum, StepBit
+    QBLT    UD_STEP_DONE, (State.Accum).b3, HoldMask
+
+    ; Time for a step!
+
+    ; Reset Accumulator status bits
+    CLR     State.Accum, State.Accum, StepBit
+
+    OR      (State.Accum).b3, (State.Accum).b3, 0x30    ; Set GuardBit and PulseHoldBit
+;    SET     State.Accum, GuardBit
+;    SET     State.Accum, PulseHoldBit
+
+    ; Update position register and select the output
+    ADD     State.Pos, State.Pos, 1
+    MOV     r3.b1, GTask.dataX
+    LDI     State.StepQ, 0x01
+    QBBC    UD_DIR_UP, State.Rate, 31
+    SUB     State.Pos, State.Pos, 2
+    MOV     r3.b1, GTask.dataY
+    LDI     State.StepQ, 0x03
+UD_DIR_UP:
+
+    ; Update state
+    XOR     r3.b0, State.StepInvert, 1
+    JAL     (GState.Call_Reg).w2, SET_CLR_BIT
+    MOV     State.T_Pulse, State.Delays
+
+UD_STEP_DONE:
+    ; Save channel state data
+    SBBO    &State.Accum, GTask.addr, $sizeof(task_header) + stepdir_state.Accum - stepdir_state.Rate, $sizeof(State) - $sizeof(State.StepInvert) - $sizeof(State.Reserved1) - stepdir_state.Accum + stepdir_state.Rate
 
     ; We're done here...carry on with the next task
     JMP     NEXT_TASK
 
+
@@ -47,6 +47,8 @@
 ;// information, go to www.linuxcnc.org.                                 //
 ;//----------------------------------------------------------------------//
 
+    #include "pru.h"
+
     .include "pru_tasks.inc"
 
     .include "pru_global_state.inc"
@@ -63,6 +65,8 @@ wait_state_size .endstruct
 GState .sassign r0, global_state
 
 State .sassign r4, wait_state   ; r4 is assigned to GState.State_Reg0
+Data  .sassign r8, wait_data      ; r8 is assigned to GState.State_Reg4
+Dog   .sassign r4, wait_watchdog  ; only used once State and Data are done with
 
 GTask .sassign r12, task_header
 
@@ -71,6 +75,9 @@ GTask .sassign r12, task_header
     .text
     
     .ref NEXT_TASK
+    .ref ENCODER_SAMPLE
+    .ref ENCPAR_SAMPLE
+    .ref SAFE_OUTPUTS
 
     .def MODE_WAIT
 MODE_WAIT:
@@ -97,10 +104,18 @@ MODE_WAIT:
     ; begins executing after a timer tick, and clear it once all work
     ; is complete and we are waiting for the next timer tick
 BUSY_CHECK:
-    QBBC    WAITLOOP, GTask.dataX, 7                     ; If MSB is set, we should twiddle the busy bit
+    QBBC    OVERSAMPLE_SETUP, GTask.dataX, 7             ; If MSB is set, we should twiddle the busy bit
     CLR     r30, r30, GTask.dataX                        ; Clear busy bit
     SET     GState.PRU_Out, GState.PRU_Out, GTask.dataX  ; Set busy bit with all other outputs after we wait for a timer tick
 
+OVERSAMPLE_SETUP:
+    ; Encoder task to sample while we wait and GPIO banks to read
+    LBBO    &Data, GTask.addr, $sizeof(task_header), $sizeof(wait_data)
+
+    ; The encoder code runs on r0-r13, park our r8-r13 in scratch pad bank 1
+    ; (r4-r7 are still in bank 0 from above)
+    XOUT    11, &Data, 24
+
 WAITLOOP:
     ; Wait until the next timer tick...
     ; FIXME:
@@ -109,7 +124,31 @@ WAITLOOP:
     ;  WBC     r31, 30
 
     LBCO    &r2, __PRU_CREG_PRU_IEP, 0x44, 4     ; Load CMP_STATUS register
-    QBBC    WAITLOOP, r2, 0                      ; Wait until counter times out
+    QBBS    TICK, r2, 0                          ; Done if counter timed out
+
+    ; Sample the encoder again, unless it might not finish before the tick,
+    ; which would mess up its time stamps
+    QBEQ    WAITLOOP, Data.Encoder, 0
+    LBCO    &r2, __PRU_CREG_PRU_IEP, 0x0C, 4     ; Load IEP count
+    QBLE    WAITLOOP, r2, Data.Deadline
+
+    ; Refresh the GPIO snapshot, so GPIO encoder inputs are sampled again too.
+    ; All tasks of this tick are done with it already.
+    JAL     (GState.Call_Reg).w2, GPIO_SNAPSHOT
+
+    MOV     GTask.addr, Data.Encoder
+    LBBO    &GState.Task_Status, GTask.addr, task_header.mode - pru_statics.mode, $sizeof(GState.Task_Status)
+    QBEQ    OVERSAMPLE_PAR, GTask.mode, eMODE_ENCODER_PAR
+    JAL     (GState.Call_Reg).w0, ENCODER_SAMPLE
+    JMP     OVERSAMPLE_DONE
+OVERSAMPLE_PAR:
+    JAL     (GState.Call_Reg).w0, ENCPAR_SAMPLE
+OVERSAMPLE_DONE:
+    XIN     10, &State, 16
+    XIN     11, &Data, 24
+    JMP     WAITLOOP
+
+TICK:
     SBCO    &r2, __PRU_CREG_PRU_IEP, 0x44, 4     ; Clear counter timeout bit
 
     ; The timer just ticked...
@@ -123,9 +162,108 @@ WAITLOOP:
     ; Clear the GPIO set/clear registers
     ZERO    &GState.GPIO0_Clr, global_state.PRU_Out - global_state.GPIO0_Clr
 
+    ; Snapshot the GPIO banks used by input pins
+    JAL     (GState.Call_Reg).w2, GPIO_SNAPSHOT
+
+    ; Advance the time base to the start of this tick
+    LBBO    &r2, r1, pru_statics.period - pru_statics.mode, 8    ; r2 = period, r3 = time
+    ADD     r3, r3, r2
+    SBBO    &r3, r1, pru_statics.time - pru_statics.mode, $sizeof(pru_statics.time)
+
+    ; Host watchdog: the driver changes Heartbeat every servo period.  If it
+    ; stays the same for Timeout ticks the watchdog bites and latches a fault.
+    LBBO    &Dog, GTask.addr, $sizeof(task_header) + $sizeof(wait_data), $sizeof(Dog)
+
+    ; Faults are only cleared here, so one the driver has not seen yet is never
+    ; lost.  A bit that differs between Clear and Cleared asks to clear that
+    ; fault.  An input that is still asserted latches it again below.
+    XOR     r2.b0, Dog.Clear, Dog.Cleared
+    QBEQ    CLEAR_DONE, r2.b0, 0
+    NOT     r2.b0, r2.b0
+    AND     Dog.Fault, Dog.Fault, r2.b0
+    MOV     Dog.Cleared, Dog.Clear
+    SBBO    &Dog.Fault, GTask.addr, $sizeof(task_header) + $sizeof(wait_data) + wait_watchdog.Fault - wait_watchdog.Heartbeat, $sizeof(Dog.Fault) + $sizeof(Dog.Cleared)
+CLEAR_DONE:
+
+    QBEQ    WD_DONE, Dog.Timeout, 0
+    QBEQ    WD_STALE, Dog.Heartbeat, Dog.Seen
+    MOV     Dog.Seen, Dog.Heartbeat
+    LDI     Dog.Ticks, 0
+    JMP     WD_SAVE
+
+WD_STALE:
+    ADD     Dog.Ticks, Dog.Ticks, 1
+    QBLT    WD_SAVE, Dog.Timeout, Dog.Ticks
+    MOV     Dog.Ticks, Dog.Timeout
+    QBBS    WD_SAVE, Dog.Fault, FAULT_WATCHDOG_BIT
+    SET     Dog.Fault, Dog.Fault, FAULT_WATCHDOG_BIT
+    SBBO    &Dog.Fault, GTask.addr, $sizeof(task_header) + $sizeof(wait_data) + wait_watchdog.Fault - wait_watchdog.Heartbeat, $sizeof(Dog.Fault)
+
+WD_SAVE:
+    SBBO    &Dog.Seen, GTask.addr, $sizeof(task_header) + $sizeof(wait_data) + wait_watchdog.Seen - wait_watchdog.Heartbeat, $sizeof(Dog.Seen) + $sizeof(Dog.Ticks)
+
+WD_DONE:
+
+    ; Stop input, latches a fault as long as it is asserted
+    QBBC    STOP_DONE, Dog.StopMode, STOP_ENABLE_BIT
+    MOV     r3, r31
+    LSR     r2.b0, Dog.StopPin, 5
+    QBEQ    STOP_PIN, r2.b0, 0
+
+    ; GPIO input, from the snapshot taken above (r1 = PRU_DATA_START)
+    SUB     r2.b0, r2.b0, 1
+    LSL     r2.b0, r2.b0, 2
+    ADD     r2.b0, r2.b0, pru_statics.gpio0_in - pru_statics.mode
+    LBBO    &r3, r1, r2.b0, 4
+
+STOP_PIN:
+    ; The shift only uses the low 5 bits of the pin number
+    LSR     r3, r3, Dog.StopPin
+    QBBC    STOP_LEVEL, Dog.StopMode, STOP_ACTIVE_LOW_BIT
+    NOT     r3, r3
+STOP_LEVEL:
+    QBBC    STOP_DONE, r3, 0
+    QBBS    STOP_DONE, Dog.Fault, FAULT_STOP_BIT
+    SET     Dog.Fault, Dog.Fault, FAULT_STOP_BIT
+    SBBO    &Dog.Fault, GTask.addr, $sizeof(task_header) + $sizeof(wait_data) + wait_watchdog.Fault - wait_watchdog.Heartbeat, $sizeof(Dog.Fault)
+
+STOP_DONE:
+    ; Keep all outputs safe as long as a fault is latched
+    QBEQ    FAULT_DONE, Dog.Fault, 0
+    JAL     (GState.Call_Reg).w0, SAFE_OUTPUTS
+FAULT_DONE:
+
     ; Save channel state data
     SBBO    &GTask.dataY, GTask.addr, task_header.dataY - task_header.mode, $sizeof(task_header.dataY)
 
     ; We're done here...carry on with the next task
     JMP     NEXT_TASK
 
+; Snapshot the GPIO banks used by input pins (Data.GpioIn) into the statics.
+; A GPIO read stalls the PRU for about 165 nS, so each used bank is read just
+; once per tick, and once per oversample.  Uses r2, returns r1 = PRU_DATA_START
+; to Call_Reg.w2
+
+GPIO_SNAPSHOT:
+    LDI     r1, PRU_DATA_START
+    QBBC    GPIO1_IN, Data.GpioIn, 0
+    SUB     r2, State.GPIO0_Clr_Addr, GPIO_CLEARDATAOUT - GPIO_DATAIN
+    LBBO    &r2, r2, 0, 4
+    SBBO    &r2, r1, pru_statics.gpio0_in - pru_statics.mode, $sizeof(pru_statics.gpio0_in)
+GPIO1_IN:
+    QBBC    GPIO2_IN, Data.GpioIn, 1
+    SUB     r2, State.GPIO1_Clr_Addr, GPIO_CLEARDATAOUT - GPIO_DATAIN
+    LBBO    &r2, r2, 0, 4
+    SBBO    &r2, r1, pru_statics.gpio1_in - pru_statics.mode, $sizeof(pru_statics.gpio1_in)
+GPIO2_IN:
+    QBBC    GPIO3_IN, Data.GpioIn, 2
+    SUB     r2, State.GPIO2_Clr_Addr, GPIO_CLEARDATAOUT - GPIO_DATAIN
+    LBBO    &r2, r2, 0, 4
+    SBBO    &r2, r1, pru_statics.gpio2_in - pru_statics.mode, $sizeof(pru_statics.gpio2_in)
+GPIO3_IN:
+    QBBC    GPIO_IN_DONE, Data.GpioIn, 3
+    SUB     r2, State.GPIO3_Clr_Addr, GPIO_CLEARDATAOUT - GPIO_DATAIN
+    LBBO    &r2, r2, 0, 4
+    SBBO    &r2, r1, pru_statics.gpio3_in - pru_statics.mode, $sizeof(pru_statics.gpio3_in)
+GPIO_IN_DONE:
+    JMP     (GState.Call_Reg).w2
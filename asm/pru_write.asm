@@ -1,14 +1,16 @@
 ;//----------------------------------------------------------------------//
 ;// Description: pru.write.p                                             //
 ;// PRU code implementing a write function                               //
-;// This is intended to primarily be used for system initialization,     //
-;// allowing some setup values (like the timer period) to be modified    //
-;// easily without requiring updates to the code.                        //
+;// Merges output bits set by the driver into the per-tick GPIO and PRU  //
+;// output shadow registers, so they are written together with all      //
+;// other outputs by the wait task.                                      //
 ;//                                                                      //
 ;// Author(s): Charles Steinkuehler                                      //
 ;// License: GNU GPL Version 2.0 or (at your option) any later version.  //
 ;//                                                                      //
 ;// Last change:                                                         //
+;// 2026-Oct    Thomas Gerner                                            //
+;//             Outputs merged into the tick shadow registers            //
 ;// 2013-May-20 Charles Steinkuehler                                     //
 ;//             Initial version                                          //
 ;//----------------------------------------------------------------------//
@@ -46,6 +48,17 @@
 ;//----------------------------------------------------------------------//
 
 
+    .include "pru_tasks.inc"
+
+    .include "pru_global_state.inc"
+    .data
+
+GState  .sassign r0, global_state
+
+Masks   .sassign r4, write_state    ; r4-r11 are assigned to GState.State_Reg0-7
+
+GTask   .sassign r12, task_header
+
     .text
     
     .def MODE_WRITE
@@ -54,11 +67,23 @@
 
 MODE_WRITE:
 
-    ; Move along...nothing to see here...
-    ; ...or feel free to write this code!
+    ; GPIO0-3 set/clear masks, or'ed into the shadow registers the wait task
+    ; writes out at the next tick
+    LBBO    &Masks, GTask.addr, $sizeof(task_header), write_state.PruClr - write_state.Gpio0Clr
+    OR      GState.GPIO0_Clr, GState.GPIO0_Clr, Masks.Gpio0Clr
+    OR      GState.GPIO0_Set, GState.GPIO0_Set, Masks.Gpio0Set
+    OR      GState.GPIO1_Clr, GState.GPIO1_Clr, Masks.Gpio1Clr
+    OR      GState.GPIO1_Set, GState.GPIO1_Set, Masks.Gpio1Set
+    OR      GState.GPIO2_Clr, GState.GPIO2_Clr, Masks.Gpio2Clr
+    OR      GState.GPIO2_Set, GState.GPIO2_Set, Masks.Gpio2Set
+    OR      GState.GPIO3_Clr, GState.GPIO3_Clr, Masks.Gpio3Clr
+    OR      GState.GPIO3_Set, GState.GPIO3_Set, Masks.Gpio3Set
 
-    ; <useful-code-goes-here>
+    ; PRU outputs keep their level in PRU_Out
+    LBBO    &r2, GTask.addr, $sizeof(task_header) + write_state.PruClr - write_state.Gpio0Clr, 8
+    NOT     r2, r2
+    AND     GState.PRU_Out, GState.PRU_Out, r2
+    OR      GState.PRU_Out, GState.PRU_Out, r3
 
     ; We're done here...carry on with the next task
     JMP     NEXT_TASK
-
@@ -0,0 +1,217 @@
+//----------------------------------------------------------------------//
+// Description: deltasig.c                                              //
+// Code to interface to a PRU driven delta-sigma modulator              //
+//                                                                      //
+// Author(s): Thomas Gerner                                             //
+// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+//                                                                      //
+// Major Changes:                                                       //
+// 2026-Oct    Thomas Gerner                                            //
+//             Initial version, based on pwmgen.c                       //
+//----------------------------------------------------------------------//
+// This file is part of LinuxCNC HAL                                    //
+//                                                                      //
+// Copyright (C) 2026  Thomas Gerner                                    //
+//                                                                      //
+// This program is free software; you can redistribute it and/or        //
+// modify it under the terms of the GNU General Public License          //
+// as published by the Free Software Foundation; either version 2       //
+// of the License, or (at your option) any later version.               //
+//                                                                      //
+// This program is distributed in the hope that it will be useful,      //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+// GNU General Public License for more details.                         //
+//                                                                      //
+// You should have received a copy of the GNU General Public License    //
+// along with this program; if not, write to the Free Software          //
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+// 02110-1301, USA.                                                     //
+//                                                                      //
+// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+// harming persons must have provisions for completely removing power   //
+// from all motors, etc, before persons enter any danger area.  All     //
+// machinery must be designed to comply with local and national safety  //
+// codes, and the authors of this software can not, and do not, take    //
+// any responsibility for such compliance.                              //
+//                                                                      //
+// This code was written as part of the LinuxCNC project.  For more     //
+// information, go to www.linuxcnc.org.                                 //
+//----------------------------------------------------------------------//
+
+#include <rtapi.h>
+#include <rtapi_string.h>
+#include <rtapi_math.h>
+
+#include <hal.h>
+
+#include "hal_pru_generic.h"
+
+int export_deltasig(hal_pru_generic_t *hpg, int i)
+{
+    char name[HAL_NAME_LEN + 1];
+    int r, j;
+
+    for (j=0; j < hpg->deltasig.instance[i].num_outputs; j++) {
+        // Export HAL Pins
+        rtapi_snprintf(name, sizeof(name), "%s.deltasig.%02d.out.%02d.enable", hpg->config.name, i, j);
+        r = hal_pin_bit_new(name, HAL_IN, &(hpg->deltasig.instance[i].out[j].hal.pin.enable), hpg->config.comp_id);
+        if (r != 0) { return r; }
+
+        rtapi_snprintf(name, sizeof(name), "%s.deltasig.%02d.out.%02d.value", hpg->config.name, i, j);
+        r = hal_pin_float_new(name, HAL_IN, &(hpg->deltasig.instance[i].out[j].hal.pin.value), hpg->config.comp_id);
+        if (r != 0) { return r; }
+
+        // Export HAL Parameters
+        rtapi_snprintf(name, sizeof(name), "%s.deltasig.%02d.out.%02d.scale", hpg->config.name, i, j);
+        r = hal_param_float_new(name, HAL_RW, &(hpg->deltasig.instance[i].out[j].hal.param.scale), hpg->config.comp_id);
+        if (r != 0) { return r; }
+
+        rtapi_snprintf(name, sizeof(name), "%s.deltasig.%02d.out.%02d.pin", hpg->config.name, i, j);
+        r = hal_param_u32_new(name, HAL_RW, &(hpg->deltasig.instance[i].out[j].hal.param.pin), hpg->config.comp_id);
+        if (r != 0) { return r; }
+
+        rtapi_snprintf(name, sizeof(name), "%s.deltasig.%02d.out.%02d.order", hpg->config.name, i, j);
+        r = hal_param_u32_new(name, HAL_RW, &(hpg->deltasig.instance[i].out[j].hal.param.order), hpg->config.comp_id);
+        if (r != 0) { return r; }
+
+        // Initialize HAL Pins
+        *(hpg->deltasig.instance[i].out[j].hal.pin.enable) = 0;
+        *(hpg->deltasig.instance[i].out[j].hal.pin.value)  = 0.0;
+
+        // Initialize HAL Parameters
+        hpg->deltasig.instance[i].out[j].hal.param.pin   = PRU_DEFAULT_PIN;
+        hpg->deltasig.instance[i].out[j].hal.param.scale = 1.0;
+        hpg->deltasig.instance[i].out[j].hal.param.order = 1;
+    }
+
+    return 0;
+}
+
+int hpg_deltasig_init(hal_pru_generic_t *hpg){
+    int r,i;
+
+    if (hpg->config.num_deltasigs <= 0)
+        return 0;
+
+    hpg->deltasig.num_instances = hpg->config.num_deltasigs;
+
+    // Allocate HAL shared memory for instance state data
+    hpg->deltasig.instance = (hpg_deltasig_instance_t *) hal_malloc(sizeof(hpg_deltasig_instance_t) * hpg->deltasig.num_instances);
+    if (hpg->deltasig.instance == 0) {
+	HPG_ERR("ERROR: hal_malloc() failed\n");
+	return -1;
+    }
+
+    // Clear memory
+    memset(hpg->deltasig.instance, 0, (sizeof(hpg_deltasig_instance_t) * hpg->deltasig.num_instances) );
+
+    for (i=0; i < hpg->deltasig.num_instances; i++) {
+
+        hpg->deltasig.instance[i].num_outputs = hpg->config.deltasig_outputs[i];
+
+        // Allocate HAL shared memory for output state data
+        hpg->deltasig.instance[i].out = (hpg_deltasig_output_instance_t *) hal_malloc(sizeof(hpg_deltasig_output_instance_t) * hpg->deltasig.instance[i].num_outputs);
+        if (hpg->deltasig.instance[i].out == 0) {
+	        HPG_ERR("ERROR: hal_malloc() failed\n");
+	        return -1;
+        }
+
+        int len = sizeof(hpg->deltasig.instance[i].pru) + (sizeof(PRU_delta_output_t) * hpg->deltasig.instance[i].num_outputs);
+        hpg->deltasig.instance[i].task.addr = pru_malloc(hpg, len);
+        hpg->deltasig.instance[i].pru.task.hdr.mode = eMODE_DELTA_SIG;
+
+        pru_task_add(hpg, &(hpg->deltasig.instance[i].task));
+
+        if ((r = export_deltasig(hpg,i)) != 0){ 
+            HPG_ERR("ERROR: failed to export deltasig %i: %i\n",i,r);
+            return -1;
+        }
+
+    }
+
+    return 0;
+}
+
+void hpg_deltasig_update(hal_pru_generic_t *hpg) {
+    int i, j;
+
+    if (hpg->deltasig.num_instances <= 0) return;
+
+    for (i = 0; i < hpg->deltasig.num_instances; i ++) {
+        double scaled_value;
+        double abs_value;
+        rtapi_u16 value;
+        rtapi_u8 mode;
+
+        PRU_delta_output_t *out = (PRU_delta_output_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->deltasig.instance[i].task.addr + sizeof(hpg->deltasig.instance[i].pru));
+
+        for (j = 0; j < hpg->deltasig.instance[i].num_outputs ; j ++) {
+
+            if (*hpg->deltasig.instance[i].out[j].hal.pin.enable == 0) {
+                value = 0;
+            } else {
+                scaled_value = *hpg->deltasig.instance[i].out[j].hal.pin.value / hpg->deltasig.instance[i].out[j].hal.param.scale;
+
+                abs_value = fabs(scaled_value);
+                if (abs_value > 1.0) abs_value = 1.0;
+
+                // The modulator input is 14 bits: 0x0000 to 0x4000 inclusive
+                value = abs_value * (double) 0x4000;
+            }
+
+            // The second order modulator moves more of the quantization noise
+            // to high frequencies, where the RC filter removes it
+            mode = (hpg->deltasig.instance[i].out[j].hal.param.order >= 2) ? DELTA_MODE_SECOND_ORDER : 0;
+
+            // Only touch the PRU when something changed, the integrator state
+            // behind value and pin belongs to the PRU
+            if (value != hpg->deltasig.instance[i].out[j].pru.value ||
+                mode != hpg->deltasig.instance[i].out[j].pru.mode ||
+                hpg->deltasig.instance[i].out[j].hal.param.pin != hpg->deltasig.instance[i].out[j].pru.pin) {
+                hpg->deltasig.instance[i].out[j].pru.value = value;
+                hpg->deltasig.instance[i].out[j].pru.pin   = hpg->deltasig.instance[i].out[j].hal.param.pin;
+                hpg->deltasig.instance[i].out[j].pru.mode  = mode;
+
+                out[j].value = hpg->deltasig.instance[i].out[j].pru.value;
+                out[j].pin   = hpg->deltasig.instance[i].out[j].pru.pin;
+                out[j].mode  = hpg->deltasig.instance[i].out[j].pru.mode;
+            }
+        }
+    }
+}
+
+void hpg_deltasig_force_write(hal_pru_generic_t *hpg) {
+    int i, j;
+
+    if (hpg->deltasig.num_instances <= 0) return;
+
+    for (i = 0; i < hpg->deltasig.num_instances; i ++) {
+
+        hpg->deltasig.instance[i].pru.task.hdr.mode = eMODE_DELTA_SIG;
+        hpg->deltasig.instance[i].pru.task.hdr.len = hpg->deltasig.instance[i].num_outputs;
+        hpg->deltasig.instance[i].pru.task.hdr.dataX = 0x00;
+        hpg->deltasig.instance[i].pru.task.hdr.dataY = 0x00;
+        hpg->deltasig.instance[i].pru.task.hdr.addr = hpg->deltasig.instance[i].task.next;
+
+        hpg->deltasig.instance[i].pru.reserved = 0;
+
+        PRU_task_delta_t *pru = (PRU_task_delta_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->deltasig.instance[i].task.addr);
+        *pru = hpg->deltasig.instance[i].pru;
+
+        // Start all outputs off with an empty integrator
+        PRU_delta_output_t *out = (PRU_delta_output_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->deltasig.instance[i].task.addr + sizeof(hpg->deltasig.instance[i].pru));
+
+        for (j = 0; j < hpg->deltasig.instance[i].num_outputs ; j ++) {
+            hpg->deltasig.instance[i].out[j].pru.value    = 0;
+            hpg->deltasig.instance[i].out[j].pru.pin      = hpg->deltasig.instance[i].out[j].hal.param.pin;
+            hpg->deltasig.instance[i].out[j].pru.mode     = 0;
+            hpg->deltasig.instance[i].out[j].pru.state    = 0;
+            out[j] = hpg->deltasig.instance[i].out[j].pru;
+        }
+    }
+
+    hpg_deltasig_update(hpg);
+}
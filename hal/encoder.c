@@ -52,169 +52,410 @@
 
 #include "hal_pru_generic.h"
 
-// LUT used to decide when/how to modify count value
-// LUT index value consists of 6-bits:
-// Mode1 Mode0 B_new A_new B_old A_old
-//
-// Mode selects counting mode:
-//   Mode 0 = Quadrature
-//   Mode 1 = Up/Down Counter (counts rising edges on A, up when B=1, down when B=0) (hostmot2 count mode)
-//   Mode 2 = Up Counter (counts rising edges on A, always counts up, B ignored)     (HAL encoder count mode)
-//   MOde 3 = Quadrature x1 count mode (HAL encoder x1 mode)
-//
-// PRU only does unsigned math, so newcout = count + LUT_Value - 1
-//      LUT = 0 : Count--
-//      LUT = 1 : No change
-//      LUT = 2 : Count++
-//      LUT = others : INVALID
-
-const PRU_encoder_LUT_t Counter_LUT = { {
-//                  New New Old Old
-// Quadrature  B A | B   A   B   A 
-// x4 Mode     ====================
-    1,      // 0 0 | 0   0   0   0 
-    0,      // 0 - | 0   0   0   1 
-    2,      // - 0 | 0   0   1   0 
-    1,      // - - | 0   0   1   1     
-    2,      // 0 + | 0   1   0   0 
-    1,      // 0 1 | 0   1   0   1 
-    1,      // - + | 0   1   1   0 
-    0,      // - 1 | 0   1   1   1 
-    0,      // + 0 | 1   0   0   0 
-    1,      // + - | 1   0   0   1 
-    1,      // 1 0 | 1   0   1   0 
-    2,      // 1 - | 1   0   1   1 
-    1,      // + + | 1   1   0   0 
-    2,      // + 1 | 1   1   0   1 
-    0,      // 1 + | 1   1   1   0 
-    1,      // 1 1 | 1   1   1   1 
-
-//                  New New Old Old
-// Up/Down     B A | B   A   B   A 
-// Mode        ====================
-    1,      // 0 0 | 0   0   0   0 
-    1,      // 0 - | 0   0   0   1 
-    1,      // - 0 | 0   0   1   0 
-    1,      // - - | 0   0   1   1     
-    0,      // 0 + | 0   1   0   0 
-    1,      // 0 1 | 0   1   0   1 
-    2,      // - + | 0   1   1   0 
-    1,      // - 1 | 0   1   1   1 
-    1,      // + 0 | 1   0   0   0 
-    1,      // + - | 1   0   0   1 
-    1,      // 1 0 | 1   0   1   0 
-    1,      // 1 - | 1   0   1   1 
-    0,      // + + | 1   1   0   0 
-    1,      // + 1 | 1   1   0   1 
-    2,      // 1 + | 1   1   1   0 
-    1,      // 1 1 | 1   1   1   1 
-
-//                  New New Old Old
-// Counter     B A | B   A   B   A 
-// Mode        ====================
-    1,      // 0 0 | 0   0   0   0 
-    1,      // 0 - | 0   0   0   1 
-    1,      // - 0 | 0   0   1   0 
-    1,      // - - | 0   0   1   1     
-    2,      // 0 + | 0   1   0   0 
-    1,      // 0 1 | 0   1   0   1 
-    2,      // - + | 0   1   1   0 
-    1,      // - 1 | 0   1   1   1 
-    1,      // + 0 | 1   0   0   0 
-    1,      // + - | 1   0   0   1 
-    1,      // 1 0 | 1   0   1   0 
-    1,      // 1 - | 1   0   1   1 
-    2,      // + + | 1   1   0   0 
-    1,      // + 1 | 1   1   0   1 
-    2,      // 1 + | 1   1   1   0 
-    1,      // 1 1 | 1   1   1   1 
-
-//                  New New Old Old
-// Quadrature  B A | B   A   B   A 
-// x1 Mode     ====================
-    1,      // 0 0 | 0   0   0   0 
-    1,      // 0 - | 0   0   0   1 
-    1,      // - 0 | 0   0   1   0 
-    1,      // - - | 0   0   1   1     
-    2,      // 0 + | 0   1   0   0 
-    1,      // 0 1 | 0   1   0   1 
-    1,      // - + | 0   1   1   0 
-    1,      // - 1 | 0   1   1   1 
-    1,      // + 0 | 1   0   0   0 
-    1,      // + - | 1   0   0   1 
-    1,      // 1 0 | 1   0   1   0 
-    1,      // 1 - | 1   0   1   1 
-    1,      // + + | 1   1   0   0 
-    1,      // + 1 | 1   1   0   1 
-    0,      // 1 + | 1   1   1   0 
-    1       // 1 1 | 1   1   1   1 
-} };
-
+// Worst case PRU time (nS) to sample an encoder task, used to stop oversampling
+// in the wait task early enough to be done before the next tick
+#define ENCODER_SAMPLE_NS       200     // task overhead
+#define ENCODER_CHAN_NS         400     // per channel, with input filter
+#define ENCODER_PAR_CHAN_NS     150     // per channel of the bit-parallel task
+#define ENCODER_GPIO_NS         165     // per GPIO bank read before each sample
+
+#define ENCODER_MAX_PIN         160     // r31 plus four GPIO banks
+
+#define ENCODER_MODE_INDEX      0x04    // PRU_encoder_hdr_t.mode: index-enable armed
+#define ENCODER_Z_HELD          0x02    // PRU_encoder_hdr_t.Z_State: index captured while armed
+
+// LUT used to decide when/how to modify count value
+// LUT index value consists of 6-bits:
+// Mode1 Mode0 B_new A_new B_old A_old
+//
+// Mode selects counting mode:
+//   Mode 0 = Quadrature
+//   Mode 1 = Up/Down Counter (counts rising edges on A, up when B=1, down when B=0) (hostmot2 count mode)
+//   Mode 2 = Up Counter (counts rising edges on A, always counts up, B ignored)     (HAL encoder count mode)
+//   MOde 3 = Quadrature x1 count mode (HAL encoder x1 mode)
+//
+// PRU only does unsigned math, so newcout = count + LUT_Value - 1
+//      LUT = 0 : Count--
+//      LUT = 1 : No change
+//      LUT = 2 : Count++
+//      LUT = 3 : Illegal quadrature transition, no change, counted as quadrature error
+//      LUT = others : INVALID
+
+const PRU_encoder_LUT_t Counter_LUT = { {
+//                  New New Old Old
+// Quadrature  B A | B   A   B   A 
+// x4 Mode     ====================
+    1,      // 0 0 | 0   0   0   0 
+    0,      // 0 - | 0   0   0   1 
+    2,      // - 0 | 0   0   1   0 
+    3,      // - - | 0   0   1   1     
+    2,      // 0 + | 0   1   0   0 
+    1,      // 0 1 | 0   1   0   1 
+    3,      // - + | 0   1   1   0 
+    0,      // - 1 | 0   1   1   1 
+    0,      // + 0 | 1   0   0   0 
+    3,      // + - | 1   0   0   1 
+    1,      // 1 0 | 1   0   1   0 
+    2,      // 1 - | 1   0   1   1 
+    3,      // + + | 1   1   0   0 
+    2,      // + 1 | 1   1   0   1 
+    0,      // 1 + | 1   1   1   0 
+    1,      // 1 1 | 1   1   1   1 
+
+//                  New New Old Old
+// Up/Down     B A | B   A   B   A 
+// Mode        ====================
+    1,      // 0 0 | 0   0   0   0 
+    1,      // 0 - | 0   0   0   1 
+    1,      // - 0 | 0   0   1   0 
+    1,      // - - | 0   0   1   1     
+    0,      // 0 + | 0   1   0   0 
+    1,      // 0 1 | 0   1   0   1 
+    2,      // - + | 0   1   1   0 
+    1,      // - 1 | 0   1   1   1 
+    1,      // + 0 | 1   0   0   0 
+    1,      // + - | 1   0   0   1 
+    1,      // 1 0 | 1   0   1   0 
+    1,      // 1 - | 1   0   1   1 
+    0,      // + + | 1   1   0   0 
+    1,      // + 1 | 1   1   0   1 
+    2,      // 1 + | 1   1   1   0 
+    1,      // 1 1 | 1   1   1   1 
+
+//                  New New Old Old
+// Counter     B A | B   A   B   A 
+// Mode        ====================
+    1,      // 0 0 | 0   0   0   0 
+    1,      // 0 - | 0   0   0   1 
+    1,      // - 0 | 0   0   1   0 
+    1,      // - - | 0   0   1   1     
+    2,      // 0 + | 0   1   0   0 
+    1,      // 0 1 | 0   1   0   1 
+    2,      // - + | 0   1   1   0 
+    1,      // - 1 | 0   1   1   1 
+    1,      // + 0 | 1   0   0   0 
+    1,      // + - | 1   0   0   1 
+    1,      // 1 0 | 1   0   1   0 
+    1,      // 1 - | 1   0   1   1 
+    2,      // + + | 1   1   0   0 
+    1,      // + 1 | 1   1   0   1 
+    2,      // 1 + | 1   1   1   0 
+    1,      // 1 1 | 1   1   1   1 
+
+//                  New New Old Old
+// Quadrature  B A | B   A   B   A 
+// x1 Mode     ====================
+    1,      // 0 0 | 0   0   0   0 
+    1,      // 0 - | 0   0   0   1 
+    1,      // - 0 | 0   0   1   0 
+    3,      // - - | 0   0   1   1     
+    2,      // 0 + | 0   1   0   0 
+    1,      // 0 1 | 0   1   0   1 
+    3,      // - + | 0   1   1   0 
+    1,      // - 1 | 0   1   1   1 
+    1,      // + 0 | 1   0   0   0 
+    3,      // + - | 1   0   0   1 
+    1,      // 1 0 | 1   0   1   0 
+    1,      // 1 - | 1   0   1   1 
+    3,      // + + | 1   1   0   0 
+    1,      // + 1 | 1   1   0   1 
+    0,      // 1 + | 1   1   1   0 
+    1       // 1 1 | 1   1   1   1 
+} };
+
+//
+// Encoder input pins: 0-31 = PRU inputs (r31), 32-159 = GPIO0-3
+//
+static rtapi_u8 hpg_encoder_pin(hal_u32_t *pin) {
+    if (*pin >= ENCODER_MAX_PIN) {
+        HPG_ERR("encoder input pin %d invalid, allowed 0 to %d, using %d\n", *pin, ENCODER_MAX_PIN - 1, PRU_DEFAULT_PIN);
+        *pin = PRU_DEFAULT_PIN;
+    }
+    return *pin;
+}
+
+static void hpg_encoder_invert_pin(rtapi_u32 *pin_invert, hal_u32_t pin) {
+    pin_invert[pin >> 5] |= 1u << (pin & 31);
+}
+
+// wait task gpio_in bit of the GPIO bank of an input pin, 0 for the PRU inputs
+static rtapi_u8 hpg_encoder_gpio_bank(hal_u32_t pin) {
+    return (pin < 32) ? 0 : 1 << ((pin >> 5) - 1);
+}
+
+//
+// PRU mode byte of a channel:
+// bits 0-1 = counter mode, bit 2 = index-enable armed,
+// bits 4-7 = input filter depth in samples (0 = off)
+//
+// The filter runs on every sample of the channel.  That is once per PRU period,
+// but an oversampled task (encoder_oversample) is sampled several times per
+// period, as often as the wait loop finds time, so its filter time is shorter
+// and depends on the PRU period, the channel count and the load of the other
+// tasks.
+//
+static rtapi_u8 hpg_encoder_mode(hpg_encoder_channel_instance_t *e) {
+    if (e->hal.param.counter_mode > 3) {
+        HPG_ERR("encoder counter-mode %d invalid, allowed 0 to 3\n", e->hal.param.counter_mode);
+        e->hal.param.counter_mode = 0;
+    }
+    if (e->hal.param.filter > 15) {
+        HPG_ERR("encoder filter %d too big, clipping to 15 samples\n", e->hal.param.filter);
+        e->hal.param.filter = 15;
+    }
+    return e->hal.param.counter_mode | (e->hal.param.filter << 4) |
+        (*(e->hal.pin.index_enable) ? ENCODER_MODE_INDEX : 0);
+}
+
+//
+// Velocity is measured hostmot2 style as counts per time between the PRU
+// timestamps of the last count change, so it stays usable far below one
+// count per servo period.  Between events the estimate decays as if a
+// count would happen right now, and drops to zero after vel-timeout.
+//
+static void hpg_encoder_update_velocity(hpg_encoder_channel_instance_t *e, rtapi_s32 reg_count_diff, rtapi_u32 event_time, rtapi_u32 now) {
+    double dT_s;
+
+    switch (e->state) {
+
+        case HM2_ENCODER_STOPPED:
+            if (reg_count_diff == 0) {
+                *(e->hal.pin.velocity) = 0.0;
+                break;
+            }
+
+            // started moving, there is no previous event to measure against yet
+            e->prev_event_rawcounts = *(e->hal.pin.rawcounts);
+            e->prev_event_time = event_time;
+            e->state = HM2_ENCODER_MOVING;
+            break;
+
+        case HM2_ENCODER_MOVING:
+            if (reg_count_diff != 0) {
+                dT_s = (rtapi_u32)(event_time - e->prev_event_time) * 1e-9;
+                if (dT_s > 0.0) {
+                    *(e->hal.pin.velocity) = ((double)(*(e->hal.pin.rawcounts) - e->prev_event_rawcounts) / dT_s) / e->hal.param.scale;
+                }
+                e->prev_event_rawcounts = *(e->hal.pin.rawcounts);
+                e->prev_event_time = event_time;
+                break;
+            }
+
+            // no counts this period, see how long it has been
+            // (the last edge may be later than the start of the current tick)
+            if ((rtapi_s32)(now - e->prev_event_time) <= 0) break;
+            dT_s = (rtapi_u32)(now - e->prev_event_time) * 1e-9;
+            if (dT_s >= e->hal.param.vel_timeout) {
+                *(e->hal.pin.velocity) = 0.0;
+                e->state = HM2_ENCODER_STOPPED;
+                break;
+            }
+
+            // the next count can't be sooner than now, so the velocity is at most
+            // one count per dT_s
+            if (dT_s > 0.0) {
+                double vel_est = (1.0 / dT_s) / fabs(e->hal.param.scale);
+                if (vel_est < fabs(*(e->hal.pin.velocity))) {
+                    *(e->hal.pin.velocity) = (*(e->hal.pin.velocity) > 0.0) ? vel_est : -vel_est;
+                }
+            }
+            break;
+    }
+}
+
 void hpg_encoder_read_chan(hal_pru_generic_t *hpg, int instance, int channel) {
-    rtapi_u16 reg_count;
+    rtapi_u32 reg_count;
     rtapi_s32 reg_count_diff;
-    rtapi_s32 prev_rawcounts;
+    rtapi_u8 qerr_diff;
 
     hpg_encoder_instance_t *inst;
     hpg_encoder_channel_instance_t *e;
 
-    inst = &hpg->encoder.instance[instance];
+    inst = &hpg->encoder.instance[instance];
     e    = &hpg->encoder.instance[instance].chan[channel];
-
-    prev_rawcounts = *e->hal.pin.rawcounts;
-
+
     // sanity check
     if (e->hal.param.scale == 0.0) {
         HPG_ERR("encoder.%02d.scale == 0.0, bogus, setting to 1.0\n", instance);
         e->hal.param.scale = 1.0;
     }
-
+
     PRU_encoder_chan_t *pruchan = (PRU_encoder_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->task.addr + sizeof(inst->pru));
-    
-    e->pru.raw.dword[1] = pruchan[channel].raw.dword[1];    // Encoder count
-    e->pru.raw.dword[2] = pruchan[channel].raw.dword[2];    // Index count and latched count
-
-    HPG_ERR("rawenc:%08x %08x %08x\n", pruchan[channel].raw.dword[0],pruchan[channel].raw.dword[1],pruchan[channel].raw.dword[2]);
-
+    
+    // re-read until the count did not change under us, so the count and
+    // its timestamp belong together
+    do {
+        e->pru.raw.dword[1] = pruchan[channel].raw.dword[1];    // Index count
+        e->pru.raw.dword[2] = pruchan[channel].raw.dword[2];    // Encoder count
+        e->pru.raw.dword[3] = pruchan[channel].raw.dword[3];    // Latched count
+        e->pru.raw.dword[4] = pruchan[channel].raw.dword[4];    // Timestamp of the last count change
+        e->pru.raw.dword[5] = pruchan[channel].raw.dword[5];    // Filter state and quadrature error count
+    } while (e->pru.raw.dword[2] != pruchan[channel].raw.dword[2]);
+
     // 
-    // figure out current rawcounts accumulated by the driver
+    // the PRU counter is as wide as rawcounts, no need to accumulate
     // 
 
     reg_count = e->pru.hdr.count;
+    reg_count_diff = (rtapi_s32)(reg_count - e->prev_reg_count);
 
-    reg_count_diff = (rtapi_s32)reg_count - (rtapi_s32)e->prev_reg_count;
-    if (reg_count_diff > 32768) reg_count_diff -= 65536;
-    if (reg_count_diff < -32768) reg_count_diff += 65536;
+    *(e->hal.pin.rawcounts) = (rtapi_s32)reg_count;
 
-    *(e->hal.pin.rawcounts) += reg_count_diff;
-
-    *(e->hal.pin.rawlatch)  = e->pru.hdr.Z_capture;
-
-    *(e->hal.pin.count) += 1;
-
     e->prev_reg_count = reg_count;
-
-}
-
-void hpg_encoder_read(hal_pru_generic_t *hpg) {
-    int i,j;
-    
+
+    //
+    // index and latch events, the PRU captures the count on every rising edge
+    // of the (optionally inverted) Z input and bumps Z_count.  While index-enable
+    // is armed only the first edge is captured and held (ENCODER_Z_HELD), so the
+    // zero offset is the count at the index edge no matter when we look.
+    //
+
+    if (e->z_resync) {
+        e->prev_Z_count = e->pru.hdr.Z_count;
+        e->z_resync = 0;
+    }
+
+    if (*(e->hal.pin.index_enable)) {
+        if (e->pru.hdr.Z_State & ENCODER_Z_HELD) {
+            e->zero_offset = (rtapi_s32)e->pru.hdr.Z_capture;
+            *(e->hal.pin.index_enable) = 0;
+        }
+    } else if (e->pru.hdr.Z_count != e->prev_Z_count && *(e->hal.pin.latch_enable)) {
+        *(e->hal.pin.rawlatch) = (rtapi_s32)e->pru.hdr.Z_capture;
+    }
+
+    e->prev_Z_count = e->pru.hdr.Z_count;
+
+    //
+    // quadrature errors, the PRU counter wraps at 256 so it is good for
+    // quite a few errors per servo period
+    //
+
+    qerr_diff = (rtapi_u8)(e->pru.hdr.qerr - e->prev_qerr);
+    if (qerr_diff != 0) {
+        *(e->hal.pin.quadrature_error_count) += qerr_diff;
+        *(e->hal.pin.quadrature_error) = 1;
+    }
+    e->prev_qerr = e->pru.hdr.qerr;
+
+    if (*(e->hal.pin.reset)) {
+        e->zero_offset = *(e->hal.pin.rawcounts);
+        *(e->hal.pin.quadrature_error) = 0;
+    }
+
+    //
+    // compute the scaled outputs
+    //
+
+    *(e->hal.pin.count) = *(e->hal.pin.rawcounts) - e->zero_offset;
+    *(e->hal.pin.position) = *(e->hal.pin.count) / e->hal.param.scale;
+
+    *(e->hal.pin.count_latch) = *(e->hal.pin.rawlatch) - e->zero_offset;
+    *(e->hal.pin.position_latch) = *(e->hal.pin.count_latch) / e->hal.param.scale;
+
+    hpg_encoder_update_velocity(e, reg_count_diff, e->pru.hdr.timestamp, hpg->encoder.time);
+}
+
+//
+// PRU address of the count of an encoder channel, used by other tasks (like the
+// closed loop stepgen) linked to an encoder.  Channels are numbered over all
+// encoder instances.  Returns 0 if the channel does not exist.
+//
+pru_addr_t hpg_encoder_count_addr(hal_pru_generic_t *hpg, int channel) {
+    int i;
+
+    if (channel < 0) return 0;
+
+    for (i = 0; i < hpg->encoder.num_instances; i ++) {
+        if (channel < hpg->encoder.instance[i].num_channels) {
+            return hpg->encoder.instance[i].task.addr + sizeof(PRU_task_encoder_t)
+                 + channel * sizeof(PRU_encoder_chan_t) + offsetof(PRU_encoder_hdr_t, count);
+        }
+        channel -= hpg->encoder.instance[i].num_channels;
+    }
+
+    return 0;
+}
+
+//
+// Channel instance of an encoder channel numbered over all encoder instances,
+// like hpg_encoder_count_addr().  Returns 0 if the channel does not exist.
+//
+hpg_encoder_channel_instance_t *hpg_encoder_channel(hal_pru_generic_t *hpg, int channel) {
+    int i;
+
+    if (channel < 0) return 0;
+
+    for (i = 0; i < hpg->encoder.num_instances; i ++) {
+        if (channel < hpg->encoder.instance[i].num_channels) {
+            return &(hpg->encoder.instance[i].chan[channel]);
+        }
+        channel -= hpg->encoder.instance[i].num_channels;
+    }
+
+    return 0;
+}
+
+//
+// Encoder task sampled by the wait task while it waits for the next tick, and
+// the last IEP count (nS into the period) at which a sample may start.  Before
+// each sample the wait task reads the GPIO banks in gpio_in again, so GPIO
+// inputs are oversampled too.  Returns 0 (no oversampling) if there is no such
+// task or a sample does not fit.
+//
+pru_addr_t hpg_encoder_oversample(hal_pru_generic_t *hpg, int instance, rtapi_u8 gpio_in, rtapi_u32 *deadline) {
+    hpg_encoder_instance_t *inst;
+    int sample_ns, bank;
+
+    *deadline = 0;
+
+    if (instance < 0) return 0;
+
+    if (instance >= hpg->encoder.num_instances) {
+        HPG_ERR("encoder_oversample = %d: no such encoder task, oversampling disabled\n", instance);
+        return 0;
+    }
+
+    inst = &hpg->encoder.instance[instance];
+    sample_ns = ENCODER_SAMPLE_NS + inst->num_channels *
+        ((inst->enc_class == eCLASS_ENC_PAR) ? ENCODER_PAR_CHAN_NS : ENCODER_CHAN_NS);
+
+    for (bank = 0; bank < 4; bank ++)
+        if (gpio_in & (1 << bank))
+            sample_ns += ENCODER_GPIO_NS;
+
+    if (sample_ns >= hpg->config.pru_period) {
+        HPG_ERR("encoder_oversample = %d: pru_period too short to oversample %d channels, oversampling disabled\n",
+            instance, inst->num_channels);
+        return 0;
+    }
+
+    *deadline = hpg->config.pru_period - sample_ns;
+    return inst->task.addr;
+}
+
+void hpg_encoder_read(hal_pru_generic_t *hpg) {
+    int i,j;
+
+    PRU_statics_t *stat = (PRU_statics_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pru_stat_addr);
+    hpg->encoder.time = stat->time;
+
     for (i = 0; i < hpg->encoder.num_instances; i ++) {
-        for (j = 0; j < hpg->encoder.instance[i].num_channels; j ++) {
+        for (j = 0; j < hpg->encoder.instance[i].num_channels; j ++) {
             hpg_encoder_read_chan(hpg, i, j);
-        }
-    }
+        }
+    }
 }
-
+
 int export_encoder(hal_pru_generic_t *hpg, int i)
 {
     char name[HAL_NAME_LEN + 1];
     int r, j;
 
     // HAL values common to all channels in this instance
-    // ...nothing to do here...
+    // ...nothing to do here...
 
-    // HAL values for individual channels
+    // HAL values for individual channels
     for (j=0; j < hpg->encoder.instance[i].num_channels; j++) {
         // Export HAL Pins
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.rawcounts", hpg->config.name, i, j);
@@ -300,7 +541,14 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
             HPG_ERR("error adding pin '%s', aborting\n", name);
             return r;
         }
-
+
+        rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.quadrature-error-count", hpg->config.name, i, j);
+        r = hal_pin_s32_new(name, HAL_OUT, &(hpg->encoder.instance[i].chan[j].hal.pin.quadrature_error_count), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("error adding pin '%s', aborting\n", name);
+            return r;
+        }
+
         // Export HAL Parameters
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.scale", hpg->config.name, i, j);
         r = hal_param_float_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.scale), hpg->config.comp_id);
@@ -308,14 +556,14 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
             HPG_ERR("error adding param '%s', aborting\n", name);
             return r;
         }
-
+
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.A-pin", hpg->config.name, i, j);
         r = hal_param_u32_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.A_pin), hpg->config.comp_id);
         if (r < 0) {
             HPG_ERR("error adding param '%s', aborting\n", name);
             return r;
         }
-
+
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.A-invert", hpg->config.name, i, j);
         r = hal_param_bit_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.A_invert), hpg->config.comp_id);
         if (r < 0) {
@@ -329,7 +577,7 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
             HPG_ERR("error adding param '%s', aborting\n", name);
             return r;
         }
-
+
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.B-invert", hpg->config.name, i, j);
         r = hal_param_bit_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.B_invert), hpg->config.comp_id);
         if (r < 0) {
@@ -343,7 +591,7 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
             HPG_ERR("error adding param '%s', aborting\n", name);
             return r;
         }
-
+
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.index-invert", hpg->config.name, i, j);
         r = hal_param_bit_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.index_invert), hpg->config.comp_id);
         if (r < 0) {
@@ -373,7 +621,7 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
         }
 
         rtapi_snprintf(name, sizeof(name), "%s.encoder.%02d.chan.%02d.filter", hpg->config.name, i, j);
-        r = hal_param_bit_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.filter), hpg->config.comp_id);
+        r = hal_param_u32_new(name, HAL_RW, &(hpg->encoder.instance[i].chan[j].hal.param.filter), hpg->config.comp_id);
         if (r < 0) {
             HPG_ERR("error adding param '%s', aborting\n", name);
             return r;
@@ -395,7 +643,7 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
         hpg->encoder.instance[i].chan[j].hal.param.index_mask = 0;
         hpg->encoder.instance[i].chan[j].hal.param.index_mask_invert = 0;
         hpg->encoder.instance[i].chan[j].hal.param.counter_mode = 0;
-//      hpg->encoder.instance[i].chan[j].hal.param.filter = 1;
+        hpg->encoder.instance[i].chan[j].hal.param.filter = 0;
         hpg->encoder.instance[i].chan[j].hal.param.vel_timeout = 0.5;
 
         *hpg->encoder.instance[i].chan[j].hal.pin.rawcounts = 0;
@@ -407,6 +655,8 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
         *hpg->encoder.instance[i].chan[j].hal.pin.position_latch = 0.0;
         *hpg->encoder.instance[i].chan[j].hal.pin.velocity = 0.0;
         *hpg->encoder.instance[i].chan[j].hal.pin.quadrature_error = 0;
+        *hpg->encoder.instance[i].chan[j].hal.pin.quadrature_error_count = 0;
+        *hpg->encoder.instance[i].chan[j].hal.pin.latch_polarity = 1;
 
         hpg->encoder.instance[i].chan[j].zero_offset = 0;
 
@@ -419,16 +669,14 @@ int export_encoder(hal_pru_generic_t *hpg, int i)
 }
 
 int hpg_encoder_init(hal_pru_generic_t *hpg){
-    int r,i;
+    int r,i,after;
 
     if (hpg->config.num_encoders <= 0)
         return 0;
-
+
 rtapi_print("hpg_encoder_init\n");
 
-    // FIXME: Support multiple encoder tasks like so:  num_encoders=3,4,2,5
-    // hpg->encoder.num_instances = hpg->config.num_encoders;
-    hpg->encoder.num_instances = 1;
+    hpg->encoder.num_instances = hpg->config.num_encoders;
 
     // Allocate HAL shared memory for instance state data
     hpg->encoder.instance = (hpg_encoder_instance_t *) hal_malloc(sizeof(hpg_encoder_instance_t) * hpg->encoder.num_instances);
@@ -444,8 +692,7 @@ rtapi_print("malloc: hpg_encoder_instance_t = %p\n",hpg->encoder.instance);
 
     for (i=0; i < hpg->encoder.num_instances; i++) {
 
-        // FIXME: Support multiple instances like so:  num_encoders=3,4,2,5
-        hpg->encoder.instance[i].num_channels = hpg->config.num_encoders;
+        hpg->encoder.instance[i].num_channels = hpg->config.encoder_channels[i];
 
         // Allocate HAL shared memory for channel state data
         hpg->encoder.instance[i].chan = (hpg_encoder_channel_instance_t *) hal_malloc(sizeof(hpg_encoder_channel_instance_t) * hpg->encoder.instance[i].num_channels);
@@ -455,14 +702,34 @@ rtapi_print("malloc: hpg_encoder_instance_t = %p\n",hpg->encoder.instance);
         }
 
 rtapi_print("malloc: hpg_encoder_channel_instance_t = %p\n",hpg->encoder.instance[i].chan);
-
-        int len = sizeof(hpg->encoder.instance[i].pru) + (sizeof(PRU_encoder_chan_t) * hpg->encoder.instance[i].num_channels);
+
+        int len = sizeof(hpg->encoder.instance[i].pru) + (sizeof(PRU_encoder_chan_t) * hpg->encoder.instance[i].num_channels);
         hpg->encoder.instance[i].task.addr = pru_malloc(hpg, len);
-        hpg->encoder.instance[i].pru.task.hdr.mode = eMODE_ENCODER;
-
-        hpg->encoder.instance[i].LUT = pru_malloc(hpg, sizeof(Counter_LUT));
 
-        pru_task_add(hpg, &(hpg->encoder.instance[i].task));
+        hpg->encoder.instance[i].enc_class = hpg->config.encoder_class[i];
+        if (hpg->encoder.instance[i].enc_class == eCLASS_ENC_PAR) {
+            hpg->encoder.instance[i].pru.task.hdr.mode = eMODE_ENCODER_PAR;
+            hpg->encoder.instance[i].LUT = pru_malloc(hpg, sizeof(PRU_encoder_par_t));
+        } else {
+            hpg->encoder.instance[i].pru.task.hdr.mode = eMODE_ENCODER;
+            hpg->encoder.instance[i].LUT = pru_malloc(hpg, sizeof(Counter_LUT));
+        }
+
+        after = hpg->config.encoder_after[i];
+        if (after >= 0 && after < hpg->stepgen.num_instances) {
+            // keep the order of encoder tasks following the same stepgen
+            if (i > 0 && hpg->config.encoder_after[i-1] == after) {
+                pru_task_insert(hpg, &(hpg->encoder.instance[i].task), &(hpg->encoder.instance[i-1].task));
+            } else {
+                pru_task_insert(hpg, &(hpg->encoder.instance[i].task), &(hpg->stepgen.instance[after].task));
+            }
+        } else {
+            if (after >= 0) {
+                HPG_ERR("encoder_after[%d] = %d: no such stepgen, adding encoder task at the end\n", i, after);
+                hpg->config.encoder_after[i] = -1;
+            }
+            pru_task_add(hpg, &(hpg->encoder.instance[i].task));
+        }
 
         if ((r = export_encoder(hpg,i)) != 0){ 
             HPG_ERR("ERROR: failed to export encoder %i: %i\n",i,r);
@@ -474,54 +741,181 @@ rtapi_print("malloc: hpg_encoder_channel_instance_t = %p\n",hpg->encoder.instanc
     return 0;
 }
 
+//
+// The bit-parallel encoder task decodes the channels on their A input bit, the
+// B and index inputs of every channel have to be at the same distance above
+// the A input, and all in the same input word.  Channels that do not fit are
+// left out, the index is dropped for the whole task if the index pins do not fit.
+//
+static void hpg_encoder_par_map(hal_pru_generic_t *hpg, int i) {
+    hpg_encoder_instance_t *inst = &hpg->encoder.instance[i];
+    int j, a, base, b_shift, z_shift;
+
+    if (inst->num_channels <= 0) return;
+
+    inst->par.bank = inst->chan[0].hal.param.A_pin >> 5;
+    base = inst->par.bank << 5;
+
+    b_shift = (int)inst->chan[0].hal.param.B_pin - (int)inst->chan[0].hal.param.A_pin;
+    z_shift = (int)inst->chan[0].hal.param.index_pin - (int)inst->chan[0].hal.param.A_pin;
+    if (z_shift < 0) z_shift = 0;
+
+    inst->par.a_mask = 0;
+    memset(inst->par.chan, 0, sizeof(inst->par.chan));
+
+    for (j = 0; j < inst->num_channels; j ++) {
+        a = (int)inst->chan[j].hal.param.A_pin - base;
+
+        if (a < 0 || a > 31) {
+            HPG_ERR("encoder.%02d.chan.%02d: all pins of the bit-parallel encoder have to be in %d-%d, channel disabled\n", i, j, base, base + 31);
+            continue;
+        }
+
+        if (b_shift <= 0 || a + b_shift > 31 || (int)inst->chan[j].hal.param.B_pin - base - a != b_shift) {
+            HPG_ERR("encoder.%02d.chan.%02d: B-pin has to be %d above A-pin for the bit-parallel encoder, channel disabled\n", i, j, b_shift);
+            continue;
+        }
+
+        if (inst->par.a_mask & (1u << a)) {
+            HPG_ERR("encoder.%02d.chan.%02d: A-pin %d used twice, channel disabled\n", i, j, a + base);
+            continue;
+        }
+
+        if (z_shift && (a + z_shift > 31 || (int)inst->chan[j].hal.param.index_pin - base - a != z_shift)) {
+            HPG_ERR("encoder.%02d.chan.%02d: index-pin has to be %d above A-pin for the bit-parallel encoder, index disabled\n", i, j, z_shift);
+            z_shift = 0;
+        }
+
+        inst->par.a_mask |= 1u << a;
+        inst->par.chan[a] = j;
+    }
+
+    inst->pru.task.hdr.dataX = b_shift > 0 ? b_shift : 0;
+    inst->pru.task.hdr.dataY = z_shift;
+
+    // the previous inputs belong to the PRU, leave them alone
+    PRU_task_encoder_t *pru = (PRU_task_encoder_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->task.addr);
+    PRU_encoder_par_t *pru_par = (PRU_encoder_par_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->LUT);
+
+    memcpy(pru_par->chan, inst->par.chan, sizeof(pru_par->chan));
+    pru_par->a_mask = inst->par.a_mask;
+    pru_par->bank   = inst->par.bank;
+    pru->task.raw.dword[0] = inst->pru.task.raw.dword[0];
+}
+
 void hpg_encoder_update(hal_pru_generic_t *hpg) {
-    int i, j;
+    int i, j;
+    int remap;
+    rtapi_u32 arm;
+    rtapi_u8 gpio_in = 0;
 
     if (hpg->encoder.num_instances <= 0) return;
 
-    for (i = 0; i < hpg->encoder.num_instances; i ++) {
-
-        // Update pin_invert register, shared between all channels
-        rtapi_u32 pin_invert = 0;
-        for (j = 0; j < hpg->encoder.instance[i].num_channels ; j ++) {
-            if (hpg->encoder.instance[i].chan[j].hal.param.A_invert)
-                pin_invert |= 1 << hpg->encoder.instance[i].chan[j].hal.param.A_pin;
-
-            if (hpg->encoder.instance[i].chan[j].hal.param.B_invert)
-                pin_invert |= 1 << hpg->encoder.instance[i].chan[j].hal.param.B_pin;
-
-            if (hpg->encoder.instance[i].chan[j].hal.param.index_invert)
-                pin_invert |= 1 << hpg->encoder.instance[i].chan[j].hal.param.index_pin;
-        }
-
-        if (hpg->encoder.instance[i].written_pin_invert != pin_invert) {
-            PRU_task_encoder_t *pru = (PRU_task_encoder_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].task.addr);
-            pru->pin_invert = pin_invert;
-            hpg->encoder.instance[i].written_pin_invert = pin_invert;
-        }
-
-        // Update per-channel state
-        for (j = 0; j < hpg->encoder.instance[i].num_channels ; j ++) {
-
-            hpg->encoder.instance[i].chan[j].pru.hdr.A_pin = hpg->encoder.instance[i].chan[j].hal.param.A_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.B_pin = hpg->encoder.instance[i].chan[j].hal.param.B_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.Z_pin = hpg->encoder.instance[i].chan[j].hal.param.index_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.mode  = hpg->encoder.instance[i].chan[j].hal.param.counter_mode;
-
-            if (hpg->encoder.instance[i].chan[j].written_state != hpg->encoder.instance[i].chan[j].pru.raw.dword[0]) {
-
-                PRU_encoder_chan_t *pruchan = (PRU_encoder_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].task.addr + sizeof(hpg->encoder.instance[i].pru));
-
-                pruchan[j].raw.dword[0] = hpg->encoder.instance[i].chan[j].pru.raw.dword[0];
-                hpg->encoder.instance[i].chan[j].written_state = hpg->encoder.instance[i].chan[j].pru.raw.dword[0];
+    for (i = 0; i < hpg->encoder.num_instances; i ++) {
+        hpg_encoder_instance_t *inst = &hpg->encoder.instance[i];
+
+        // Update per-channel state
+        remap = 0;
+        for (j = 0; j < inst->num_channels ; j ++) {
+
+            inst->chan[j].pru.hdr.A_pin = hpg_encoder_pin(&(inst->chan[j].hal.param.A_pin));
+            inst->chan[j].pru.hdr.B_pin = hpg_encoder_pin(&(inst->chan[j].hal.param.B_pin));
+            inst->chan[j].pru.hdr.Z_pin = hpg_encoder_pin(&(inst->chan[j].hal.param.index_pin));
+            inst->chan[j].pru.hdr.mode  = hpg_encoder_mode(&(inst->chan[j]));
+
+            if (inst->chan[j].written_state != inst->chan[j].pru.raw.dword[0]) {
+
+                PRU_encoder_chan_t *pruchan = (PRU_encoder_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->task.addr + sizeof(inst->pru));
+
+                // the low three bytes are the pins, the top one is the mode
+                if ((inst->chan[j].written_state ^ inst->chan[j].pru.raw.dword[0]) & 0x00FFFFFF)
+                    remap = 1;
+
+                pruchan[j].raw.dword[0] = inst->chan[j].pru.raw.dword[0];
+                inst->chan[j].written_state = inst->chan[j].pru.raw.dword[0];
             }
         }
+
+        if (inst->enc_class == eCLASS_ENC_PAR) {
+            if (remap)
+                hpg_encoder_par_map(hpg, i);
+
+            // the bit-parallel task arms index-enable per A input bit
+            arm = 0;
+            for (j = 0; j < inst->num_channels ; j ++) {
+                rtapi_u32 a = inst->chan[j].hal.param.A_pin & 31;
+                if (*(inst->chan[j].hal.pin.index_enable) && (inst->par.a_mask & (1u << a)) && inst->par.chan[a] == j)
+                    arm |= 1u << a;
+            }
+
+            if (arm != inst->par.arm) {
+                PRU_encoder_par_t *pru_par = (PRU_encoder_par_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->LUT);
+                pru_par->arm = arm;
+                inst->par.arm = arm;
+            }
+        }
+
+        // Update the pin inversion of the PRU inputs (r31) and the GPIO banks,
+        // shared between all channels
+        rtapi_u32 pin_invert[5];
+        int z_invert;
+
+        memset(pin_invert, 0, sizeof(pin_invert));
+        for (j = 0; j < inst->num_channels ; j ++) {
+            if (inst->chan[j].hal.param.A_invert)
+                hpg_encoder_invert_pin(pin_invert, inst->chan[j].hal.param.A_pin);
+
+            if (inst->chan[j].hal.param.B_invert)
+                hpg_encoder_invert_pin(pin_invert, inst->chan[j].hal.param.B_pin);
+
+            // the PRU captures on rising Z edges, so latching on the falling
+            // edge is done by inverting Z while the latch is armed
+            z_invert = inst->chan[j].hal.param.index_invert;
+            if (*(inst->chan[j].hal.pin.latch_enable) &&
+                !*(inst->chan[j].hal.pin.index_enable) &&
+                !*(inst->chan[j].hal.pin.latch_polarity))
+                z_invert = !z_invert;
+
+            if (z_invert)
+                hpg_encoder_invert_pin(pin_invert, inst->chan[j].hal.param.index_pin);
+
+            // changing the inversion looks like an edge to the PRU, ignore it
+            if (z_invert != inst->chan[j].written_z_invert) {
+                inst->chan[j].z_resync = 1;
+                inst->chan[j].written_z_invert = z_invert;
+            }
+
+            // GPIO banks the wait task has to read for this task
+            if (inst->enc_class != eCLASS_ENC_PAR) {
+                gpio_in |= hpg_encoder_gpio_bank(inst->chan[j].hal.param.A_pin);
+                gpio_in |= hpg_encoder_gpio_bank(inst->chan[j].hal.param.B_pin);
+                gpio_in |= hpg_encoder_gpio_bank(inst->chan[j].hal.param.index_pin);
+            }
+        }
+
+        // the bit-parallel task inverts its one input word with pin_invert
+        if (inst->enc_class == eCLASS_ENC_PAR) {
+            pin_invert[0] = pin_invert[inst->par.bank];
+            memset(&pin_invert[1], 0, 4 * sizeof(rtapi_u32));
+            gpio_in |= hpg_encoder_gpio_bank(inst->par.bank << 5);
+        }
+
+        if (inst->written_pin_invert != pin_invert[0] ||
+            memcmp(inst->written_gpio_invert, &pin_invert[1], sizeof(inst->written_gpio_invert))) {
+            PRU_task_encoder_t *pru = (PRU_task_encoder_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) inst->task.addr);
+            pru->pin_invert = pin_invert[0];
+            memcpy(pru->gpio_invert, &pin_invert[1], sizeof(pru->gpio_invert));
+            inst->written_pin_invert = pin_invert[0];
+            memcpy(inst->written_gpio_invert, &pin_invert[1], sizeof(inst->written_gpio_invert));
+        }
     }
+
+    hpg->encoder.gpio_in = gpio_in;
 }
-
-//
-// *_force_write sets up any persistent state data required that does not get
-// written by the standard *_update() procedure, above
+
+//
+// *_force_write sets up any persistent state data required that does not get
+// written by the standard *_update() procedure, above
 //
 void hpg_encoder_force_write(hal_pru_generic_t *hpg) {
     int i, j;
@@ -531,43 +925,58 @@ void hpg_encoder_force_write(hal_pru_generic_t *hpg) {
     for (i = 0; i < hpg->encoder.num_instances; i ++) {
 
         PRU_task_encoder_t *pru = (PRU_task_encoder_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].task.addr);
-
-        // Global data common to all channels
-        hpg->encoder.instance[i].pru.task.hdr.mode  = eMODE_ENCODER;
+
+        // Global data common to all channels
+        hpg->encoder.instance[i].pru.task.hdr.mode  = (hpg->encoder.instance[i].enc_class == eCLASS_ENC_PAR) ? eMODE_ENCODER_PAR : eMODE_ENCODER;
         hpg->encoder.instance[i].pru.task.hdr.len   = hpg->encoder.instance[i].num_channels;
         hpg->encoder.instance[i].pru.task.hdr.dataX = 0x00;
         hpg->encoder.instance[i].pru.task.hdr.dataY = 0x00;
         hpg->encoder.instance[i].pru.task.hdr.addr  = hpg->encoder.instance[i].task.next;
 
-        hpg->encoder.instance[i].pru.pin_invert = 0;
+        hpg->encoder.instance[i].pru.pin_invert = 0;
         hpg->encoder.instance[i].pru.LUT        = hpg->encoder.instance[i].LUT;
+        memset(hpg->encoder.instance[i].pru.gpio_invert, 0, sizeof(hpg->encoder.instance[i].pru.gpio_invert));
+
+        *pru = hpg->encoder.instance[i].pru;
+
+        hpg->encoder.instance[i].written_pin_invert = hpg->encoder.instance[i].pru.pin_invert;
+        memset(hpg->encoder.instance[i].written_gpio_invert, 0, sizeof(hpg->encoder.instance[i].written_gpio_invert));
 
-        *pru = hpg->encoder.instance[i].pru;
-
-        hpg->encoder.instance[i].written_pin_invert = hpg->encoder.instance[i].pru.pin_invert;
-
-        // Per-channel data
+        // Per-channel data
         PRU_encoder_chan_t *pruchan = (PRU_encoder_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].task.addr + sizeof(hpg->encoder.instance[i].pru));
 
-        for (j = 0; j < hpg->encoder.instance[i].num_channels; j ++) {
-            hpg->encoder.instance[i].chan[j].pru.hdr.A_pin = hpg->encoder.instance[i].chan[j].hal.param.A_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.B_pin = hpg->encoder.instance[i].chan[j].hal.param.B_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.Z_pin = hpg->encoder.instance[i].chan[j].hal.param.index_pin;
-            hpg->encoder.instance[i].chan[j].pru.hdr.mode  = hpg->encoder.instance[i].chan[j].hal.param.counter_mode;
-
+        for (j = 0; j < hpg->encoder.instance[i].num_channels; j ++) {
+            hpg->encoder.instance[i].chan[j].pru.hdr.A_pin = hpg_encoder_pin(&(hpg->encoder.instance[i].chan[j].hal.param.A_pin));
+            hpg->encoder.instance[i].chan[j].pru.hdr.B_pin = hpg_encoder_pin(&(hpg->encoder.instance[i].chan[j].hal.param.B_pin));
+            hpg->encoder.instance[i].chan[j].pru.hdr.Z_pin = hpg_encoder_pin(&(hpg->encoder.instance[i].chan[j].hal.param.index_pin));
+            hpg->encoder.instance[i].chan[j].pru.hdr.mode  = hpg_encoder_mode(&(hpg->encoder.instance[i].chan[j]));
+
             hpg->encoder.instance[i].chan[j].pru.raw.dword[1]  = 0;
             hpg->encoder.instance[i].chan[j].pru.raw.dword[2]  = 0;
-
-            pruchan[j] = hpg->encoder.instance[i].chan[j].pru;
-
+            hpg->encoder.instance[i].chan[j].pru.raw.dword[3]  = 0;
+            hpg->encoder.instance[i].chan[j].pru.raw.dword[4]  = 0;
+            hpg->encoder.instance[i].chan[j].pru.raw.dword[5]  = 0;
+
+            pruchan[j] = hpg->encoder.instance[i].chan[j].pru;
+
             hpg->encoder.instance[i].chan[j].written_state = hpg->encoder.instance[i].chan[j].pru.raw.dword[0];
         }
-
-        // LUT Table
-        PRU_encoder_LUT_t *pru_lut = (PRU_encoder_LUT_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].LUT);
-        *pru_lut = Counter_LUT;
+
+        if (hpg->encoder.instance[i].enc_class == eCLASS_ENC_PAR) {
+            // Bit-parallel state, the map also sets the pin distances in the task header
+            PRU_encoder_par_t *pru_par = (PRU_encoder_par_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].LUT);
+            pru_par->prev = 0;
+            pru_par->arm  = 0;
+            pru_par->held = 0;
+            hpg->encoder.instance[i].par.arm = 0;
+            hpg_encoder_par_map(hpg, i);
+        } else {
+            // LUT Table
+            PRU_encoder_LUT_t *pru_lut = (PRU_encoder_LUT_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->encoder.instance[i].LUT);
+            *pru_lut = Counter_LUT;
+        }
     }
 
-    // Call the regular update routine to finish up
+    // Call the regular update routine to finish up
     hpg_encoder_update(hpg);
 }
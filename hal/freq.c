@@ -0,0 +1,261 @@
+//----------------------------------------------------------------------//
+// Description: freq.c                                                  //
+// Code to interface to the PRU frequency counter task                  //
+//                                                                      //
+// Author(s): Thomas Gerner                                             //
+// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+//                                                                      //
+// Major Changes:                                                       //
+// 2026-Oct    Thomas Gerner                                            //
+//             Initial version, based on input.c                        //
+//----------------------------------------------------------------------//
+// This file is part of LinuxCNC HAL                                    //
+//                                                                      //
+// Copyright (C) 2026  Thomas Gerner                                    //
+//                                                                      //
+// This program is free software; you can redistribute it and/or        //
+// modify it under the terms of the GNU General Public License          //
+// as published by the Free Software Foundation; either version 2       //
+// of the License, or (at your option) any later version.               //
+//                                                                      //
+// This program is distributed in the hope that it will be useful,      //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+// GNU General Public License for more details.                         //
+//                                                                      //
+// You should have received a copy of the GNU General Public License    //
+// along with this program; if not, write to the Free Software          //
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+// 02110-1301, USA.                                                     //
+//                                                                      //
+// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+// harming persons must have provisions for completely removing power   //
+// from all motors, etc, before persons enter any danger area.  All     //
+// machinery must be designed to comply with local and national safety  //
+// codes, and the authors of this software can not, and do not, take    //
+// any responsibility for such compliance.                              //
+//                                                                      //
+// This code was written as part of the LinuxCNC project.  For more     //
+// information, go to www.linuxcnc.org.                                 //
+//----------------------------------------------------------------------//
+
+
+#include <rtapi.h>
+#include <rtapi_string.h>
+#include <rtapi_math.h>
+
+#include <hal.h>
+
+#include "hal_pru_generic.h"
+
+
+#define FREQ_MAX_PIN 160            // PRU inputs 0-31, GPIO0-3 32-159
+
+int export_freq(hal_pru_generic_t *hpg, int i)
+{
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // Export HAL Pins
+    rtapi_snprintf(name, sizeof(name), "%s.freq.%02d.frequency", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_OUT, &(hpg->freq.instance[i].hal.pin.frequency), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.freq.%02d.count", hpg->config.name, i);
+    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->freq.instance[i].hal.pin.count), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Export HAL Parameters
+    rtapi_snprintf(name, sizeof(name), "%s.freq.%02d.pin", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->freq.instance[i].hal.param.pin), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.freq.%02d.timeout", hpg->config.name, i);
+    r = hal_param_float_new(name, HAL_RW, &(hpg->freq.instance[i].hal.param.timeout), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Initialize HAL Pins
+    *(hpg->freq.instance[i].hal.pin.frequency) = 0.0;
+    *(hpg->freq.instance[i].hal.pin.count)     = 0;
+
+    // Initialize HAL Parameters
+    hpg->freq.instance[i].hal.param.pin     = PRU_DEFAULT_PIN;
+    hpg->freq.instance[i].hal.param.timeout = 1.0;
+
+    return 0;
+}
+
+int hpg_freq_init(hal_pru_generic_t *hpg){
+    int r,i;
+
+    if (hpg->config.num_freqs <= 0)
+        return 0;
+
+    hpg->freq.num_instances = hpg->config.num_freqs;
+
+    // Allocate HAL shared memory for frequency counter state data
+    hpg->freq.instance = (hpg_freq_instance_t *) hal_malloc(sizeof(hpg_freq_instance_t) * hpg->freq.num_instances);
+    if (hpg->freq.instance == 0) {
+	HPG_ERR("ERROR: hal_malloc() failed\n");
+	return -1;
+    }
+
+    // Clear memory
+    memset(hpg->freq.instance, 0, (sizeof(hpg_freq_instance_t) * hpg->freq.num_instances) );
+
+    // All channels share one frequency counter task
+    int len = sizeof(hpg->freq.pru) + (sizeof(PRU_freq_chan_t) * hpg->freq.num_instances);
+    hpg->freq.task.addr = pru_malloc(hpg, len);
+    hpg->freq.pru.task.hdr.mode = eMODE_FREQ;
+
+    pru_task_add(hpg, &(hpg->freq.task));
+
+    for (i=0; i < hpg->freq.num_instances; i++) {
+        if ((r = export_freq(hpg,i)) != 0){ 
+            HPG_ERR("ERROR: failed to export freq %i: %i\n",i,r);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void hpg_freq_update(hal_pru_generic_t *hpg) {
+    int i;
+    rtapi_u8 gpio_in = 0;
+
+    if (hpg->freq.num_instances <= 0) return;
+
+    PRU_freq_chan_t *pru = (PRU_freq_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->freq.task.addr + sizeof(hpg->freq.pru));
+
+    for (i = 0; i < hpg->freq.num_instances; i ++) {
+        hpg_freq_instance_t *f = &(hpg->freq.instance[i]);
+
+        if (f->hal.param.pin >= FREQ_MAX_PIN) {
+            HPG_ERR("freq pin %d invalid, allowed 0 to %d, using %d\n", f->hal.param.pin, FREQ_MAX_PIN - 1, PRU_DEFAULT_PIN);
+            f->hal.param.pin = PRU_DEFAULT_PIN;
+        }
+
+        // Only the pin byte belongs to the driver
+        if (f->pru.pin != f->hal.param.pin) {
+            f->pru.pin = f->hal.param.pin;
+            pru[i].pin = f->pru.pin;
+        }
+
+        // The wait task reads the GPIO banks of the inputs at the start of every tick
+        if (f->hal.param.pin >= 32)
+            gpio_in |= 1 << ((f->hal.param.pin >> 5) - 1);
+    }
+
+    hpg->freq.gpio_in = gpio_in;
+}
+
+//
+// Reciprocal (1/T) measurement: the edges counted since the last read divided
+// by the time between the last edge of the previous read and the newest edge,
+// so the resolution is one PRU period instead of one edge per servo period
+//
+static void hpg_freq_read_chan(hpg_freq_instance_t *f, PRU_freq_chan_t *pru, rtapi_u32 now) {
+    rtapi_u32 count, time;
+    double dT_s;
+
+    // The PRU may store a new edge between the two reads, retry until the
+    // count matches the time
+    do {
+        count = pru->count;
+        time  = pru->time;
+    } while (count != pru->count);
+
+    f->pru.count = count;
+    f->pru.time  = time;
+    *(f->hal.pin.count) = count;
+
+    switch (f->state) {
+        case FREQ_STOPPED:
+            if (count != f->prev_count) {
+                // first edge after a stop, there is no previous edge to measure against yet
+                f->prev_count = count;
+                f->prev_time  = time;
+                f->state = FREQ_RUNNING;
+            }
+            break;
+
+        case FREQ_RUNNING:
+            if (count != f->prev_count) {
+                dT_s = (rtapi_u32)(time - f->prev_time) * 1e-9;
+                if (dT_s > 0.0) {
+                    *(f->hal.pin.frequency) = (rtapi_u32)(count - f->prev_count) / dT_s;
+                }
+                f->prev_count = count;
+                f->prev_time  = time;
+                break;
+            }
+
+            // no edges this period, see how long it has been
+            // (the last edge may be later than the start of the current tick)
+            if ((rtapi_s32)(now - f->prev_time) <= 0) break;
+            dT_s = (rtapi_u32)(now - f->prev_time) * 1e-9;
+            if (dT_s >= f->hal.param.timeout) {
+                *(f->hal.pin.frequency) = 0.0;
+                f->state = FREQ_STOPPED;
+                break;
+            }
+
+            // the next edge can't be sooner than now, so the frequency is at
+            // most one edge per dT_s
+            if (1.0 / dT_s < *(f->hal.pin.frequency)) {
+                *(f->hal.pin.frequency) = 1.0 / dT_s;
+            }
+            break;
+    }
+}
+
+void hpg_freq_read(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->freq.num_instances <= 0) return;
+
+    PRU_statics_t *stat = (PRU_statics_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pru_stat_addr);
+    PRU_freq_chan_t *pru = (PRU_freq_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->freq.task.addr + sizeof(hpg->freq.pru));
+
+    for (i = 0; i < hpg->freq.num_instances; i ++) {
+        hpg_freq_read_chan(&(hpg->freq.instance[i]), &(pru[i]), stat->time);
+    }
+}
+
+void hpg_freq_force_write(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->freq.num_instances <= 0) return;
+
+    hpg->freq.pru.task.hdr.mode  = eMODE_FREQ;
+    hpg->freq.pru.task.hdr.len   = hpg->freq.num_instances;
+    hpg->freq.pru.task.hdr.dataX = 0x00;
+    hpg->freq.pru.task.hdr.dataY = 0x00;
+    hpg->freq.pru.task.hdr.addr  = hpg->freq.task.next;
+
+    PRU_task_freq_t *pru = (PRU_task_freq_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->freq.task.addr);
+    *pru = hpg->freq.pru;
+
+    PRU_freq_chan_t *chan = (PRU_freq_chan_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->freq.task.addr + sizeof(hpg->freq.pru));
+
+    for (i = 0; i < hpg->freq.num_instances; i ++) {
+        hpg_freq_instance_t *f = &(hpg->freq.instance[i]);
+
+        f->pru.pin      = f->hal.param.pin;
+        f->pru.level    = 0;
+        f->pru.reserved = 0;
+        f->pru.count    = 0;
+        f->pru.time     = 0;
+        chan[i] = f->pru;
+
+        f->prev_count = 0;
+        f->prev_time  = 0;
+        f->state      = FREQ_STOPPED;
+        *(f->hal.pin.frequency) = 0.0;
+    }
+
+    hpg_freq_update(hpg);
+}
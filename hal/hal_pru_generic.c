@@ -104,15 +104,61 @@ RTAPI_MP_INT(num_stepgens, "Number of step generators (default: 0)");
  *   create the step generator of step_class[i]
  */
 static char *step_class[MAX_CHAN];
-RTAPI_MP_ARRAY_STRING(step_class,MAX_CHAN,"Class of step generator, s ... step/dir, 4 ... 4 pin phase, e ... edge step/dir");
+RTAPI_MP_ARRAY_STRING(step_class,MAX_CHAN,"Class of step generator, s ... step/dir, 4 ... 4 pin phase, e ... edge step/dir, c ... closed loop step/dir, m ... sine/cosine microstepping, u ... up/down (CW/CCW), g ... step/dir geared to an encoder");
 
-static int num_pwmgens = 0;
-RTAPI_MP_INT(num_pwmgens, "Number of PWM outputs (default: 0)");
-//int num_pwmgens[MAX_CHAN] = { -1, -1, -1, -1, -1, -1, -1, -1 };
-//RTAPI_MP_ARRAY_INT(num_pwmgens, "Number of PWM outputs for up to 8 banks (default: 0)");
+/*
+ * Every pwmgen task has its own PWM period, so outputs with very different
+ * frequencies go into separate tasks, like num_pwmgens=1,4,1
+ */
+static int num_pwmgens[MAX_CHAN];
+RTAPI_MP_ARRAY_INT(num_pwmgens, MAX_CHAN, "Number of PWM outputs for up to 8 pwmgen tasks (default: 0)");
+
+/*
+ * Delta-sigma outputs give a smooth analog voltage behind an RC filter,
+ * one entry per task like num_pwmgens
+ */
+static int num_deltasigs[MAX_CHAN];
+RTAPI_MP_ARRAY_INT(num_deltasigs, MAX_CHAN, "Number of delta-sigma outputs for up to 8 delta-sigma tasks (default: 0)");
+
+static int num_inputs = 0;
+RTAPI_MP_INT(num_inputs, "Number of debounced inputs read by the PRU (default: 0)");
+
+static int num_outputs = 0;
+RTAPI_MP_INT(num_outputs, "Number of outputs written by the PRU every tick (default: 0)");
+
+static int num_freqs = 0;
+RTAPI_MP_INT(num_freqs, "Number of frequency counter inputs (default: 0)");
+
+static int num_psos = 0;
+RTAPI_MP_INT(num_psos, "Number of position synchronized outputs (default: 0)");
+
+static int num_encoders[MAX_CHAN];
+RTAPI_MP_ARRAY_INT(num_encoders, MAX_CHAN, "Number of encoder channels for up to 8 encoder tasks (default: 0)");
+
+/*
+ * By default the encoder tasks run after all step generators.  encoder_after[k]
+ * places encoder task k directly after step generator encoder_after[k] instead,
+ * to spread the input sampling over the PRU period.
+ */
+static int encoder_after[MAX_CHAN] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+RTAPI_MP_ARRAY_INT(encoder_after, MAX_CHAN, "Step generator after which each encoder task runs (default: -1, after all step generators)");
+
+/*
+ * encoder_class[k] selects how encoder task k decodes its channels.  The bit-parallel
+ * class only does quadrature x4 without input filter, and needs the B (and index)
+ * input of every channel at the same distance above its A input.
+ */
+static char *encoder_class[MAX_CHAN];
+RTAPI_MP_ARRAY_STRING(encoder_class, MAX_CHAN, "Class of encoder task, q ... one channel at a time, p ... all channels bit-parallel");
 
-static int num_encoders = 0;
-RTAPI_MP_INT(num_encoders, "Number of encoder channels (default: 0)");
+/*
+ * The wait task can keep sampling one encoder task while it waits for the next
+ * tick, which raises the maximum count rate of that encoder way beyond one edge
+ * per PRU period.  The input filter of that task counts samples instead of PRU
+ * periods then, so its filter depth has to be raised for the same filter time.
+ */
+static int encoder_oversample = -1;
+RTAPI_MP_INT(encoder_oversample, "Encoder task sampled while the PRU waits for the next period (default: -1, none)");
 
 static char *prucode = "";
 RTAPI_MP_STRING(prucode, "filename of PRU code (.bin, default: stepgen.bin)");
@@ -126,6 +172,9 @@ RTAPI_MP_INT(pru_period, "PRU task period (in nS, default: 10,000 nS or 100 KHz)
 static int disabled = 0;
 RTAPI_MP_INT(disabled, "start the PRU in disabled state for debugging (0=enabled, 1=disabled, default: enabled");
 
+static int debug = 0;
+RTAPI_MP_INT(debug, "export and update the stepgen debug and test pins (0=off, 1=on, default: off)");
+
 /***********************************************************************
 *                   STRUCTURES AND GLOBAL VARIABLES                    *
 ************************************************************************/
@@ -185,6 +234,7 @@ void hpg_wait_force_write(hal_pru_generic_t *hpg);
 void hpg_wait_update(hal_pru_generic_t *hpg);
 
 static hpg_step_class_t parse_step_class(const char *sclass);
+static hpg_encoder_class_t parse_encoder_class(const char *eclass);
 
 /***********************************************************************
 *                       INIT AND EXIT CODE                             *
@@ -220,12 +270,18 @@ int rtapi_app_main(void)
     }
 
     // Setup global state
-    hpg->config.num_pwmgens   = num_pwmgens;
+    hpg->config.num_pwmgens   = 0;
+    hpg->config.num_deltasigs = 0;
     hpg->config.num_stepgens  = num_stepgens;
-    hpg->config.num_encoders  = num_encoders;
+    hpg->config.num_encoders  = 0;
+    hpg->config.num_inputs    = num_inputs;
+    hpg->config.num_outputs   = num_outputs;
+    hpg->config.num_freqs     = num_freqs;
+    hpg->config.num_psos      = num_psos;
     hpg->config.comp_id       = comp_id;
     hpg->config.pru_period    = pru_period;
     hpg->config.name          = modname;
+    hpg->config.debug         = debug;
 
     // create step class configuration
     if (num_stepgens > 0) {
@@ -246,9 +302,50 @@ int rtapi_app_main(void)
         }
     }
 
+    // count pwmgen tasks, the list ends at the first entry without outputs
+    while (hpg->config.num_pwmgens < MAX_CHAN && num_pwmgens[hpg->config.num_pwmgens] > 0) {
+        hpg->config.num_pwmgens++;
+    }
+    hpg->config.pwmgen_outputs = num_pwmgens;
+
+    // count delta-sigma tasks the same way
+    while (hpg->config.num_deltasigs < MAX_CHAN && num_deltasigs[hpg->config.num_deltasigs] > 0) {
+        hpg->config.num_deltasigs++;
+    }
+    hpg->config.deltasig_outputs = num_deltasigs;
+
+    // count encoder tasks, the list ends at the first entry without channels
+    while (hpg->config.num_encoders < MAX_CHAN && num_encoders[hpg->config.num_encoders] > 0) {
+        hpg->config.num_encoders++;
+    }
+    hpg->config.encoder_channels = num_encoders;
+    hpg->config.encoder_after    = encoder_after;
+    hpg->config.encoder_oversample = encoder_oversample;
+
+    // create encoder class configuration
+    if (hpg->config.num_encoders > 0) {
+        int i;
+
+        hpg->config.encoder_class = hal_malloc(hpg->config.num_encoders * sizeof(hpg_encoder_class_t));
+        for (i = 0; i < hpg->config.num_encoders; i++) {
+            hpg_encoder_class_t ec = parse_encoder_class(encoder_class[i]);
+            if (ec == eCLASS_ENC_NONE) {
+                HPG_ERR("ERROR: unsupported encoder class %s for encoder %d\n", encoder_class[i], i);
+                hal_exit(comp_id);
+                return -1;
+            }
+            hpg->config.encoder_class[i] = ec;
+        }
+    }
+
     rtapi_print("num_pwmgens  : %d\n",hpg->config.num_pwmgens);
+    rtapi_print("num_deltasigs: %d\n",hpg->config.num_deltasigs);
     rtapi_print("num_stepgens : %d\n",hpg->config.num_stepgens);
     rtapi_print("num_encoders : %d\n",hpg->config.num_encoders);
+    rtapi_print("num_inputs   : %d\n",hpg->config.num_inputs);
+    rtapi_print("num_outputs  : %d\n",hpg->config.num_outputs);
+    rtapi_print("num_freqs    : %d\n",hpg->config.num_freqs);
+    rtapi_print("num_psos     : %d\n",hpg->config.num_psos);
 
     rtapi_print("Init pwm\n");
     // Initialize various functions and generate PRU data ram contents
@@ -258,6 +355,13 @@ int rtapi_app_main(void)
         return -1;
     }
 
+    rtapi_print("Init deltasig\n");
+    if ((retval = hpg_deltasig_init(hpg))) {
+        HPG_ERR("ERROR: deltasig init failed: %d\n", retval);
+        hal_exit(comp_id);
+        return -1;
+    }
+
     rtapi_print("Init stepgen\n");
     if ((retval = hpg_stepgen_init(hpg))) {
         HPG_ERR("ERROR: stepgen init failed: %d\n", retval);
@@ -272,6 +376,34 @@ int rtapi_app_main(void)
         return -1;
     }
 
+    rtapi_print("Init input\n");
+    if ((retval = hpg_input_init(hpg))) {
+        HPG_ERR("ERROR: input init failed: %d\n", retval);
+        hal_exit(comp_id);
+        return -1;
+    }
+
+    rtapi_print("Init freq\n");
+    if ((retval = hpg_freq_init(hpg))) {
+        HPG_ERR("ERROR: freq init failed: %d\n", retval);
+        hal_exit(comp_id);
+        return -1;
+    }
+
+    rtapi_print("Init pso\n");
+    if ((retval = hpg_pso_init(hpg))) {
+        HPG_ERR("ERROR: pso init failed: %d\n", retval);
+        hal_exit(comp_id);
+        return -1;
+    }
+
+    rtapi_print("Init output\n");
+    if ((retval = hpg_output_init(hpg))) {
+        HPG_ERR("ERROR: output init failed: %d\n", retval);
+        hal_exit(comp_id);
+        return -1;
+    }
+
     if ((retval = hpg_wait_init(hpg))) {
         HPG_ERR("ERROR: global task init failed: %d\n", retval);
         hal_exit(comp_id);
@@ -286,7 +418,12 @@ int rtapi_app_main(void)
 
     hpg_stepgen_force_write(hpg);
     hpg_pwmgen_force_write(hpg);
+    hpg_deltasig_force_write(hpg);
     hpg_encoder_force_write(hpg);
+    hpg_input_force_write(hpg);
+    hpg_freq_force_write(hpg);
+    hpg_pso_force_write(hpg);
+    hpg_output_force_write(hpg);
     hpg_wait_force_write(hpg);
 
     if ((retval = setup_pru(pru, prucode, disabled, hpg))) {
@@ -315,6 +452,8 @@ static void hpg_read(void *void_hpg, long period) {
 
     hpg_stepgen_read(hpg, period);
     hpg_encoder_read(hpg);
+    hpg_input_read(hpg);
+    hpg_freq_read(hpg);
 
 }
 
@@ -326,9 +465,18 @@ rtapi_u16 ns2periods(hal_pru_generic_t *hpg, hal_u32_t ns) {
 static void hpg_write(void *void_hpg, long period) {
     hal_pru_generic_t *hpg      = void_hpg;
 
-    hpg_stepgen_update(hpg, period);
-    hpg_pwmgen_update(hpg);
+    // Leave the outputs alone while the PRU holds them safe, they are all
+    // written again once the fault is cleared
+    if (!hpg->wait.watchdog.fault) {
+        hpg_stepgen_update(hpg, period);
+        hpg_pwmgen_update(hpg);
+        hpg_deltasig_update(hpg);
+        hpg_pso_update(hpg);
+        hpg_output_update(hpg);
+    }
     hpg_encoder_update(hpg);
+    hpg_input_update(hpg);
+    hpg_freq_update(hpg);
     hpg_wait_update(hpg);
 
 }
@@ -551,6 +699,17 @@ void pru_task_add(hal_pru_generic_t *hpg, pru_task_t *task)
     }
 }
 
+void pru_task_insert(hal_pru_generic_t *hpg, pru_task_t *task, pru_task_t *after)
+{
+    // Insert this task into the task list directly after another task
+    HPG_DBG("Inserting task: addr=%04x prev=%04x\n", task->addr, after->addr);
+    task->next  = after->next;
+    after->next = task->addr;
+    if (hpg->last_task == after) {
+        hpg->last_task = task;
+    }
+}
+
 void pru_shutdown(int pru)
 {
     pru_stop(pru);
@@ -562,7 +721,7 @@ int hpg_wait_init(hal_pru_generic_t *hpg)
     char name[HAL_NAME_LEN + 1];
     int r;
 
-    hpg->wait.task.addr = pru_malloc(hpg, sizeof(hpg->wait.pru));
+    hpg->wait.task.addr = pru_malloc(hpg, sizeof(hpg->wait.pru) + sizeof(hpg->wait.watchdog));
 
     pru_task_add(hpg, &(hpg->wait.task));
 
@@ -572,9 +731,135 @@ int hpg_wait_init(hal_pru_generic_t *hpg)
 
     hpg->hal.param.pru_busy_pin = 0x80;
 
+    rtapi_snprintf(name, sizeof(name), "%s.watchdog.has_bit", hpg->config.name);
+    r = hal_pin_bit_new(name, HAL_IO, &(hpg->hal.pin.watchdog_has_bit), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.watchdog.timeout_ns", hpg->config.name);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->hal.param.watchdog_timeout_ns), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stop.tripped", hpg->config.name);
+    r = hal_pin_bit_new(name, HAL_IO, &(hpg->hal.pin.stop_tripped), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stop.pin", hpg->config.name);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->hal.param.stop_pin), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stop.enable", hpg->config.name);
+    r = hal_param_bit_new(name, HAL_RW, &(hpg->hal.param.stop_enable), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stop.active_low", hpg->config.name);
+    r = hal_param_bit_new(name, HAL_RW, &(hpg->hal.param.stop_active_low), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    *(hpg->hal.pin.watchdog_has_bit) = 0;
+    *(hpg->hal.pin.stop_tripped) = 0;
+    hpg->hal.param.watchdog_timeout_ns = 5000000;
+    hpg->hal.param.stop_pin = PRU_DEFAULT_PIN;
+    hpg->hal.param.stop_enable = 0;
+    hpg->hal.param.stop_active_low = 1;
+
     return 0;
 }
 
+//
+// Watchdog timeout in PRU periods, 0 disables the watchdog
+//
+static rtapi_u16 hpg_watchdog_timeout(hal_pru_generic_t *hpg) {
+    rtapi_u32 ticks = ceil((double)hpg->hal.param.watchdog_timeout_ns / (double)hpg->config.pru_period);
+
+    if (ticks > 0xFFFF) {
+        HPG_ERR("watchdog timeout %d nS too long, clipping to 65535 PRU periods\n", hpg->hal.param.watchdog_timeout_ns);
+        ticks = 0xFFFF;
+        hpg->hal.param.watchdog_timeout_ns = ticks * hpg->config.pru_period;
+    }
+
+    return ticks;
+}
+
+//
+// The PRU zeroed the stepgen rates and the pwmgen, deltasig and output values
+// while a fault was latched, and the driver did not update them.  Invalidate
+// the shadows of the values only written on change, so the next update writes
+// them again.  The stepgen feed forward restarts from the current command.
+//
+static void hpg_fault_resync(hal_pru_generic_t *hpg) {
+    int i, j;
+
+    for (i = 0; i < hpg->stepgen.num_instances; i ++) {
+        hpg->stepgen.instance[i].written_task = ~hpg->stepgen.instance[i].pru.task.raw.dword[0];
+        hpg->stepgen.instance[i].pru_cl.flags = ~hpg->stepgen.instance[i].pru_cl.flags;
+        hpg->stepgen.instance[i].pru_gear.flags = ~hpg->stepgen.instance[i].pru_gear.flags;
+        hpg->stepgen.instance[i].old_position_cmd = *(hpg->stepgen.instance[i].hal.pin.position_cmd);
+    }
+
+    for (i = 0; i < hpg->pwmgen.num_instances; i ++)
+        hpg->pwmgen.instance[i].table_dirty = 1;
+
+    for (i = 0; i < hpg->deltasig.num_instances; i ++)
+        for (j = 0; j < hpg->deltasig.instance[i].num_outputs; j ++)
+            hpg->deltasig.instance[i].out[j].pru.value = 0xFFFF;
+
+    memset(hpg->output.pru.gpio, 0, sizeof(hpg->output.pru.gpio));
+    memset(&hpg->output.pru.pru, 0, sizeof(hpg->output.pru.pru));
+
+    for (i = 0; i < hpg->pso.num_instances; i ++)
+        hpg->pso.instance[i].rearm = 1;
+}
+
+//
+// Stop input pin and mode, a GPIO stop input adds its bank to the banks the
+// wait task reads every tick
+//
+static void hpg_stop_config(hal_pru_generic_t *hpg, rtapi_u8 *pin, rtapi_u8 *mode, rtapi_u8 *gpio_in) {
+    *pin = 0;
+    *mode = 0;
+    *gpio_in = 0;
+
+    if (hpg->hal.param.stop_pin >= 160) {
+        HPG_ERR("stop pin %d invalid, allowed 0 to 159, stop input disabled\n", hpg->hal.param.stop_pin);
+        hpg->hal.param.stop_pin = PRU_DEFAULT_PIN;
+        hpg->hal.param.stop_enable = 0;
+    }
+
+    if (!hpg->hal.param.stop_enable)
+        return;
+
+    *pin  = hpg->hal.param.stop_pin;
+    *mode = PRU_STOP_ENABLE | (hpg->hal.param.stop_active_low ? PRU_STOP_ACTIVE_LOW : 0);
+    if (*pin >= 32)
+        *gpio_in = 1 << ((*pin >> 5) - 1);
+}
+
+//
+// Report a latched PRU fault on its has_bit pin, and ask the PRU to clear it
+// once the user clears the pin.  The PRU owns the fault byte, the driver only
+// toggles the fault's bit in clear.
+//
+static void hpg_fault_report(hal_pru_generic_t *hpg, PRU_wait_watchdog_t *wd, rtapi_u8 fault, hal_bit_t *has_bit, int *reported, const char *msg) {
+    if (!(hpg->wait.watchdog.fault & fault))
+        return;
+
+    // Still waiting for the PRU to clear it
+    if ((hpg->wait.watchdog.clear ^ hpg->wait.watchdog.cleared) & fault)
+        return;
+
+    if (*reported && *has_bit == 0) {
+        hpg->wait.watchdog.clear ^= fault;
+        wd->clear = hpg->wait.watchdog.clear;
+        *reported = 0;
+    } else {
+        if (!*reported)
+            HPG_ERR("%s\n", msg);
+        *has_bit = 1;
+        *reported = 1;
+    }
+}
+
+
 void hpg_wait_force_write(hal_pru_generic_t *hpg)
 {
     hpg->wait.pru.task.hdr.mode = eMODE_WAIT;
@@ -582,19 +867,77 @@ void hpg_wait_force_write(hal_pru_generic_t *hpg)
     hpg->wait.pru.task.hdr.dataY = 0x00;
     hpg->wait.pru.task.hdr.addr = hpg->wait.task.next;
 
+    rtapi_u8 stop_gpio;
+
+    // The watchdog is armed by the first update, so a slow start of the
+    // servo thread does not trip it.  The PRU is not running yet, so this is
+    // the one place the driver writes the PRU owned fields too.
+    memset(&hpg->wait.watchdog, 0, sizeof(hpg->wait.watchdog));
+    hpg->wait.watchdog_reported = 0;
+    hpg->wait.stop_reported = 0;
+    hpg_stop_config(hpg, &hpg->wait.watchdog.stop_pin, &hpg->wait.watchdog.stop_mode, &stop_gpio);
+
+    hpg->wait.pru.gpio_in = hpg->encoder.gpio_in | hpg->input.gpio_in | hpg->freq.gpio_in | stop_gpio;
+    hpg->wait.pru.encoder = hpg_encoder_oversample(hpg, hpg->config.encoder_oversample, hpg->wait.pru.gpio_in, &(hpg->wait.pru.deadline));
+
     PRU_task_wait_t *pru = (PRU_task_wait_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->wait.task.addr);
     *pru = hpg->wait.pru;
 
+    PRU_wait_watchdog_t *wd = (PRU_wait_watchdog_t *) (pru + 1);
+    *wd = hpg->wait.watchdog;
+
     PRU_statics_t *stat = (PRU_statics_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pru_stat_addr);
     *stat = hpg->pru_stat;
 }
 
 void hpg_wait_update(hal_pru_generic_t *hpg) {
+    rtapi_u8 stop_pin, stop_mode, stop_gpio, gpio_in, fault;
+
     if (hpg->wait.pru.task.hdr.dataX != hpg->hal.param.pru_busy_pin)
         hpg->wait.pru.task.hdr.dataX = hpg->hal.param.pru_busy_pin;
 
+    hpg_stop_config(hpg, &stop_pin, &stop_mode, &stop_gpio);
+    gpio_in = hpg->encoder.gpio_in | hpg->input.gpio_in | hpg->freq.gpio_in | stop_gpio;
+
+    // Every oversample reads the GPIO banks again, which moves the deadline
+    if (gpio_in != hpg->wait.pru.gpio_in) {
+        hpg->wait.pru.gpio_in = gpio_in;
+        hpg->wait.pru.encoder = hpg_encoder_oversample(hpg, hpg->config.encoder_oversample, hpg->wait.pru.gpio_in, &(hpg->wait.pru.deadline));
+    }
+
     PRU_task_wait_t *pru = (PRU_task_wait_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->wait.task.addr);
     *pru = hpg->wait.pru;
+
+    PRU_wait_watchdog_t *wd = (PRU_wait_watchdog_t *) (pru + 1);
+
+    // A fault stays latched on the PRU until its pin is cleared.  The PRU
+    // writes fault before cleared, so read cleared first.
+    fault = hpg->wait.watchdog.fault;
+    hpg->wait.watchdog.cleared = wd->cleared;
+    hpg->wait.watchdog.fault = wd->fault;
+    if (fault && !hpg->wait.watchdog.fault)
+        hpg_fault_resync(hpg);
+
+    hpg_fault_report(hpg, wd, PRU_FAULT_WATCHDOG, hpg->hal.pin.watchdog_has_bit, &hpg->wait.watchdog_reported,
+        "watchdog has bit, all outputs are off until watchdog.has_bit is cleared");
+    hpg_fault_report(hpg, wd, PRU_FAULT_STOP, hpg->hal.pin.stop_tripped, &hpg->wait.stop_reported,
+        "stop input tripped, all outputs are off until stop.tripped is cleared");
+
+    if (stop_pin != hpg->wait.watchdog.stop_pin || stop_mode != hpg->wait.watchdog.stop_mode) {
+        hpg->wait.watchdog.stop_pin  = stop_pin;
+        hpg->wait.watchdog.stop_mode = stop_mode;
+        wd->stop_pin  = stop_pin;
+        wd->stop_mode = stop_mode;
+    }
+
+    rtapi_u16 timeout = hpg_watchdog_timeout(hpg);
+    if (timeout != hpg->wait.watchdog.timeout) {
+        hpg->wait.watchdog.timeout = timeout;
+        wd->timeout = hpg->wait.watchdog.timeout;
+    }
+
+    hpg->wait.watchdog.heartbeat++;
+    wd->heartbeat = hpg->wait.watchdog.heartbeat;
 }
 
 static hpg_step_class_t parse_step_class(const char *sclass)
@@ -613,6 +956,22 @@ static hpg_step_class_t parse_step_class(const char *sclass)
 	  case 'E' :
 	  	ret_class = eCLASS_EDGESTEP_DIR;
 	  	break;
+	  case 'c' :
+	  case 'C' :
+	  	ret_class = eCLASS_STEP_DIR_CL;
+	  	break;
+	  case 'm' :
+	  case 'M' :
+	  	ret_class = eCLASS_STEP_MICRO;
+	  	break;
+	  case 'u' :
+	  case 'U' :
+	  	ret_class = eCLASS_STEP_UP_DOWN;
+	  	break;
+	  case 'g' :
+	  case 'G' :
+	  	ret_class = eCLASS_STEP_GEAR;
+	  	break;
 	  default :
 	  	ret_class = eCLASS_NONE;
 	  }
@@ -620,3 +979,24 @@ static hpg_step_class_t parse_step_class(const char *sclass)
     return ret_class;
 }
 
+static hpg_encoder_class_t parse_encoder_class(const char *eclass)
+{
+	  hpg_encoder_class_t ret_class;
+	  if (eclass == NULL)
+	  	return eCLASS_ENC_QUAD;
+	  switch (*eclass) {
+	  case 'q' :
+	  case 'Q' :
+	  case '\0' :	// default to one channel at a time
+	  	ret_class = eCLASS_ENC_QUAD;
+	  	break;
+	  case 'p' :
+	  case 'P' :
+	  	ret_class = eCLASS_ENC_PAR;
+	  	break;
+	  default :
+	  	ret_class = eCLASS_ENC_NONE;
+	  }
+
+    return ret_class;
+}
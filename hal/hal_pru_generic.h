@@ -101,7 +101,7 @@ typedef struct {
             hal_bit_t       *enable;
             hal_bit_t       *control_type;              // 0="position control", 1="velocity control"
 
-            // debug pins
+            // debug pins, only exported with debug=1
             hal_float_t     *dbg_ff_vel;
             hal_float_t     *dbg_vel_error;
             hal_float_t     *dbg_s_to_match;
@@ -112,6 +112,17 @@ typedef struct {
             hal_s32_t       *test1;
             hal_s32_t       *test2;
             hal_s32_t       *test3;
+
+            // closed loop pins
+            hal_bit_t       *cl_enable;
+            hal_float_t     *following_error;
+            hal_s32_t       *correction_steps;
+
+            // gearing pins
+            hal_bit_t       *gear_enable;
+            hal_float_t     *gear_ratio;                // machine units per encoder count
+            hal_float_t     *gear_sync_error;
+            hal_bit_t       *gear_locked;
         } pin;
 
         struct {
@@ -137,8 +148,23 @@ typedef struct {
                 hal_u32_t     pin_d;
 
                 hal_u32_t     type;
+                hal_u32_t     microsteps;           // microstep class only
               } phase;
             };
+
+            // closed loop parameters
+            struct {
+                hal_u32_t     encoder;              // encoder channel, counted over all encoder instances
+                hal_float_t   counts_per_step;
+                hal_u32_t     deadband;             // in encoder counts
+                hal_u32_t     max_error;            // in encoder counts
+            } cl;
+
+            // gearing parameters
+            struct {
+                hal_u32_t     encoder;              // encoder channel, counted over all encoder instances
+                hal_float_t   blend_time;           // seconds to ramp the ratio from 0 to gear-ratio
+            } gear;
         } param;
 
     } hal;
@@ -163,27 +189,49 @@ typedef struct {
     rtapi_u32 written_dirhold;
     rtapi_u32 written_task;
     rtapi_u32 written_phase;
+
+    // closed loop extension of the PRU task, only used by the closed loop class
+    PRU_stepgen_cl_t pru_cl;
+    double written_counts_per_step;
+
+    // gearing extension of the PRU task, only used by the gearing class
+    PRU_stepgen_gear_t pru_gear;
 } hpg_stepgen_instance_t;
 
 typedef struct {
     int num_instances;
     hpg_stepgen_instance_t  *instance;
+    pru_addr_t sine_table;                  // shared by all microstep instances
 } hpg_stepgen_t;
 
 typedef struct {
-    // PRU control and state data
-    PRU_task_delta_t PRU;
 
-    // HAL Pins
-    hal_bit_t       *hal_enable;
+    PRU_delta_output_t  pru;
+
+    struct {
+
+        struct {
+            hal_float_t *value;
+            hal_bit_t   *enable;
+        } pin;
+
+        struct {
+            hal_float_t scale;
+            hal_u32_t   pin;
+            hal_u32_t   order;      // 1 = first order, 2 = second order modulator
+        } param;
+
+    } hal;
 
-    hal_float_t     *hal_out1;
-    hal_float_t     *hal_out2;
+} hpg_deltasig_output_instance_t;
 
-    // HAL Parameters
-    hal_u32_t       hal_pin1;
-    hal_u32_t       hal_pin2;
+typedef struct {
+    // PRU control and state data
+    PRU_task_delta_t    pru;
+    pru_task_t          task;
 
+    int num_outputs;
+    hpg_deltasig_output_instance_t  *out;
 } hpg_deltasig_instance_t;
 
 typedef struct {
@@ -223,10 +271,15 @@ typedef struct {
     struct {
         struct {
             hal_u32_t   pwm_period;
+            hal_u32_t   pwm_resolution;     // duty cycle steps per PWM period, 0 = as many as possible
         } param;
     } hal;
 
     rtapi_u32 written_pwm_period;
+    rtapi_u32 written_pwm_resolution;
+
+    rtapi_u16 table[2];             // offsets of the two PRU output tables from the task address
+    int       table_dirty;          // output values changed, but not yet written to the PRU
 } hpg_pwmgen_instance_t;
 
 typedef struct {
@@ -238,6 +291,8 @@ typedef struct {
 // encoder
 //
 
+typedef enum { eCLASS_ENC_QUAD, eCLASS_ENC_PAR, eCLASS_ENC_NONE } hpg_encoder_class_t;
+
 typedef struct {
 
     PRU_encoder_chan_t  pru;
@@ -256,7 +311,8 @@ typedef struct {
             hal_bit_t   *index_enable;
             hal_bit_t   *latch_enable;
             hal_bit_t   *latch_polarity;
-            hal_bit_t   *quadrature_error;
+            hal_bit_t   *quadrature_error;        // sticky, cleared by reset
+            hal_s32_t   *quadrature_error_count;
         } pin;
 
         struct {
@@ -270,7 +326,7 @@ typedef struct {
             hal_bit_t   index_mask;
             hal_bit_t   index_mask_invert;
             hal_u32_t   counter_mode;
-            hal_bit_t   filter;
+            hal_u32_t   filter;         // input filter depth in samples (PRU periods unless oversampled), 0 = off
             hal_float_t vel_timeout;
         } param;
 
@@ -278,18 +334,18 @@ typedef struct {
 
     rtapi_s32 zero_offset;  // *hal.pin.counts == (*hal.pin.rawcounts - zero_offset)
 
-    rtapi_u16 prev_reg_count;  // from this and the current count in the register we compute a change-in-counts, which we add to rawcounts
+    rtapi_u32 prev_reg_count;  // count seen by the previous read, the difference drives the velocity estimate
 
-    rtapi_s32 prev_dS_counts;  // last time the function ran, it saw this many counts from the time before *that*
+    rtapi_u8 prev_qerr;        // PRU quadrature error count seen by the previous read
+    rtapi_u8 prev_Z_count;     // a change of the PRU Z_count means an index (or latch) event was seen
+    int written_z_invert;      // Z inversion currently written to the PRU, includes latch polarity
+    int z_resync;              // set when the Z inversion changed, the next Z_count change is bogus
 
     rtapi_u32 written_state;
 
     // these two are the datapoint last time we moved (only valid if state == HM2_ENCODER_MOVING)
     rtapi_s32 prev_event_rawcounts;
-    rtapi_u16 prev_event_reg_timestamp;
-
-    rtapi_s32 tsc_num_rollovers;
-    rtapi_u16 prev_time_of_interest;
+    rtapi_u32 prev_event_time; // PRU timestamp in nS, see PRU_statics_t.time
 
     enum { HM2_ENCODER_STOPPED, HM2_ENCODER_MOVING } state;
 
@@ -306,38 +362,217 @@ typedef struct {
     // Instance-wide HAL variables
     // ...nothing to see here...
 
-    pru_addr_t LUT;
+    hpg_encoder_class_t enc_class;
+
+    pru_addr_t LUT;                 // counter LUT, or the bit-parallel state for eCLASS_ENC_PAR
+    PRU_encoder_par_t par;          // bit-parallel pin map last written to the PRU
     rtapi_u32 written_pin_invert;
+    rtapi_u32 written_gpio_invert[4];
 } hpg_encoder_instance_t;
 
 typedef struct {
     int num_instances;
     hpg_encoder_instance_t  *instance;
+    rtapi_u32 time;             // PRU time base in nS at the start of the current tick, see PRU_statics_t
+    rtapi_u8 gpio_in;           // GPIO banks used by encoder inputs, see PRU_task_wait_t
 } hpg_encoder_t;
 
+//
+// input (read task)
+//
+
+typedef struct {
+
+    PRU_read_input_t    pru;
+
+    struct {
+
+        struct {
+            hal_bit_t   *in;
+            hal_bit_t   *in_not;
+            hal_u32_t   *edges;
+        } pin;
+
+        struct {
+            hal_u32_t   pin;
+            hal_u32_t   debounce;   // nS a new input level has to be stable
+        } param;
+
+    } hal;
+
+} hpg_input_instance_t;
+
+typedef struct {
+    int num_instances;
+    hpg_input_instance_t    *instance;
+
+    // PRU control and state data
+    PRU_task_read_t     pru;
+    pru_task_t          task;
+
+    rtapi_u8 gpio_in;           // GPIO banks used by the inputs, see PRU_task_wait_t
+} hpg_input_t;
+
+//
+// frequency counter
+//
+
+typedef struct {
+
+    PRU_freq_chan_t     pru;
+
+    struct {
+
+        struct {
+            hal_float_t *frequency;
+            hal_s32_t   *count;
+        } pin;
+
+        struct {
+            hal_u32_t   pin;
+            hal_float_t timeout;    // seconds without an edge after which frequency drops to 0
+        } param;
+
+    } hal;
+
+    rtapi_u32 prev_count;           // edge count and time of the last edge at the previous read
+    rtapi_u32 prev_time;
+    enum { FREQ_STOPPED, FREQ_RUNNING } state;
+} hpg_freq_instance_t;
+
+typedef struct {
+    int num_instances;
+    hpg_freq_instance_t     *instance;
+
+    // PRU control and state data
+    PRU_task_freq_t     pru;
+    pru_task_t          task;
+
+    rtapi_u8 gpio_in;           // GPIO banks used by the inputs, see PRU_task_wait_t
+} hpg_freq_t;
+
+//
+// position synchronized output
+//
+
+typedef struct {
+
+    PRU_task_pso_t      pru;
+    pru_task_t          task;
+
+    struct {
+
+        struct {
+            hal_bit_t   *enable;    // rising edge starts the positions at start
+            hal_float_t *start;     // first position, machine units of the source
+            hal_float_t *spacing;   // distance between positions, 0 = start only
+            hal_u32_t   *count;     // number of positions, 0 = no limit
+            hal_u32_t   *fired;     // positions passed since enabled
+            hal_u32_t   *pending;   // positions queued on the PRU
+            hal_bit_t   *done;      // all positions passed
+        } pin;
+
+        struct {
+            hal_u32_t   pin;        // same numbering as the stepgen and pwmgen pins
+            hal_bit_t   invert;
+            hal_u32_t   pulse_width;    // nS, 0 = toggle the output at every position
+            hal_s32_t   source;         // stepgen or encoder channel watched, -1 = none
+            hal_bit_t   source_encoder; // source is an encoder channel instead of a stepgen
+        } param;
+
+    } hal;
+
+    int enabled;                // task enabled by the last update
+    int rearm;                  // disabled by a fault until enable is cleared
+    rtapi_u32 queued;           // positions queued since enabled
+    rtapi_u32 fired_base;       // PRU fired count when enabled
+    rtapi_s32 written_source;   // source and source_encoder last checked
+    int written_source_encoder;
+} hpg_pso_instance_t;
+
+typedef struct {
+    int num_instances;
+    hpg_pso_instance_t      *instance;
+} hpg_pso_t;
+
+//
+// output (write task)
+//
+
+typedef struct {
+
+    struct {
+
+        struct {
+            hal_bit_t   *out;
+        } pin;
+
+        struct {
+            hal_u32_t   pin;        // same numbering as the stepgen and pwmgen pins
+            hal_bit_t   invert;
+        } param;
+
+    } hal;
+
+} hpg_output_instance_t;
+
+typedef struct {
+    int num_instances;
+    hpg_output_instance_t   *instance;
+
+    // PRU control and state data
+    PRU_task_write_t    pru;
+    pru_task_t          task;
+} hpg_output_t;
+
 
 typedef struct {
     PRU_task_wait_t     pru;
     pru_task_t          task;
+
+    PRU_wait_watchdog_t watchdog;   // host watchdog and stop input, follows pru in PRU memory
+    int watchdog_reported;          // watchdog fault seen and reported on has_bit
+    int stop_reported;              // stop fault seen and reported on stop.tripped
 } hpg_wait_t;
 
-typedef enum { eCLASS_STEP_DIR, eCLASS_STEP_PHASE, eCLASS_EDGESTEP_DIR, eCLASS_NONE } hpg_step_class_t;
+typedef enum { eCLASS_STEP_DIR, eCLASS_STEP_PHASE, eCLASS_EDGESTEP_DIR, eCLASS_STEP_DIR_CL, eCLASS_STEP_MICRO, eCLASS_STEP_UP_DOWN, eCLASS_STEP_GEAR, eCLASS_NONE } hpg_step_class_t;
 
 typedef struct _hal_pru_generic_t {
 
     struct {
         int pru_period;
-        int num_pwmgens;
+        int num_pwmgens;            // number of pwmgen tasks
+        int *pwmgen_outputs;        // number of outputs per pwmgen task
+        int num_deltasigs;          // number of delta-sigma tasks
+        int *deltasig_outputs;      // number of outputs per delta-sigma task
         int num_stepgens;
         hpg_step_class_t *step_class;
-        int num_encoders;
+        int num_encoders;           // number of encoder tasks
+        int num_inputs;             // number of inputs debounced by the read task
+        int num_outputs;            // number of outputs set by the write task
+        int num_freqs;              // number of frequency counter inputs
+        int num_psos;               // number of position synchronized outputs
+        int *encoder_channels;      // number of channels per encoder task
+        int *encoder_after;         // stepgen index each encoder task follows, -1 for the default position
+        hpg_encoder_class_t *encoder_class;
+        int encoder_oversample;     // encoder task sampled by the wait task, -1 for none
         int comp_id;
         const char *name;
+        int debug;                  // export the stepgen debug and test pins
     } config;
 
     struct {
+        struct {
+            hal_bit_t   *watchdog_has_bit;  // set when the watchdog bites, clear to reset
+            hal_bit_t   *stop_tripped;      // set when the stop input asserts, clear to reset
+        } pin;
+
         struct {
             hal_u32_t   pru_busy_pin;
+            hal_u32_t   watchdog_timeout_ns;
+            hal_u32_t   stop_pin;
+            hal_bit_t   stop_enable;
+            hal_bit_t   stop_active_low;
         } param;
     } hal;
 
@@ -363,6 +598,10 @@ typedef struct _hal_pru_generic_t {
     hpg_deltasig_t  deltasig;
     hpg_encoder_t   encoder;
 
+    hpg_input_t     input;
+    hpg_output_t    output;
+    hpg_freq_t      freq;
+    hpg_pso_t       pso;
     hpg_wait_t      wait;
 
 } hal_pru_generic_t;
@@ -374,6 +613,7 @@ typedef struct _hal_pru_generic_t {
 
 pru_addr_t pru_malloc(hal_pru_generic_t *hpg, int len);
 void pru_task_add(hal_pru_generic_t *hpg, pru_task_t *task);
+void pru_task_insert(hal_pru_generic_t *hpg, pru_task_t *task, pru_task_t *after);
 
 
 //
@@ -385,6 +625,15 @@ void hpg_pwmgen_force_write(hal_pru_generic_t *hpg);
 void hpg_pwmgen_update(hal_pru_generic_t *hpg);
 
 
+//
+// deltasig functions
+//
+
+int hpg_deltasig_init(hal_pru_generic_t *hpg);
+void hpg_deltasig_force_write(hal_pru_generic_t *hpg);
+void hpg_deltasig_update(hal_pru_generic_t *hpg);
+
+
 //
 // stepgen functions
 //
@@ -404,5 +653,46 @@ int hpg_encoder_init(hal_pru_generic_t *hpg);
 void hpg_encoder_force_write(hal_pru_generic_t *hpg);
 void hpg_encoder_update(hal_pru_generic_t *hpg);
 void hpg_encoder_read(hal_pru_generic_t *hpg);
+pru_addr_t hpg_encoder_count_addr(hal_pru_generic_t *hpg, int channel);
+hpg_encoder_channel_instance_t *hpg_encoder_channel(hal_pru_generic_t *hpg, int channel);
+pru_addr_t hpg_encoder_oversample(hal_pru_generic_t *hpg, int instance, rtapi_u8 gpio_in, rtapi_u32 *deadline);
+
+
+//
+// input functions
+//
+
+int hpg_input_init(hal_pru_generic_t *hpg);
+void hpg_input_force_write(hal_pru_generic_t *hpg);
+void hpg_input_update(hal_pru_generic_t *hpg);
+void hpg_input_read(hal_pru_generic_t *hpg);
+
+
+//
+// output functions
+//
+
+int hpg_output_init(hal_pru_generic_t *hpg);
+void hpg_output_force_write(hal_pru_generic_t *hpg);
+void hpg_output_update(hal_pru_generic_t *hpg);
+
+
+//
+// frequency counter functions
+//
+
+int hpg_freq_init(hal_pru_generic_t *hpg);
+void hpg_freq_force_write(hal_pru_generic_t *hpg);
+void hpg_freq_update(hal_pru_generic_t *hpg);
+void hpg_freq_read(hal_pru_generic_t *hpg);
+
+
+//
+// position synchronized output functions
+//
+
+int hpg_pso_init(hal_pru_generic_t *hpg);
+void hpg_pso_force_write(hal_pru_generic_t *hpg);
+void hpg_pso_update(hal_pru_generic_t *hpg);
 
 #endif
@@ -0,0 +1,230 @@
+//----------------------------------------------------------------------//
+// Description: input.c                                                 //
+// Code to interface to the PRU read task, debounced input pins         //
+//                                                                      //
+// Author(s): Thomas Gerner                                             //
+// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+//                                                                      //
+// Major Changes:                                                       //
+// 2026-Oct    Thomas Gerner                                            //
+//             Initial version, based on pwmgen.c                       //
+//----------------------------------------------------------------------//
+// This file is part of LinuxCNC HAL                                    //
+//                                                                      //
+// Copyright (C) 2026  Thomas Gerner                                    //
+//                                                                      //
+// This program is free software; you can redistribute it and/or        //
+// modify it under the terms of the GNU General Public License          //
+// as published by the Free Software Foundation; either version 2       //
+// of the License, or (at your option) any later version.               //
+//                                                                      //
+// This program is distributed in the hope that it will be useful,      //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+// GNU General Public License for more details.                         //
+//                                                                      //
+// You should have received a copy of the GNU General Public License    //
+// along with this program; if not, write to the Free Software          //
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+// 02110-1301, USA.                                                     //
+//                                                                      //
+// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+// harming persons must have provisions for completely removing power   //
+// from all motors, etc, before persons enter any danger area.  All     //
+// machinery must be designed to comply with local and national safety  //
+// codes, and the authors of this software can not, and do not, take    //
+// any responsibility for such compliance.                              //
+//                                                                      //
+// This code was written as part of the LinuxCNC project.  For more     //
+// information, go to www.linuxcnc.org.                                 //
+//----------------------------------------------------------------------//
+
+#include <rtapi.h>
+#include <rtapi_string.h>
+#include <rtapi_math.h>
+
+#include <hal.h>
+
+#include "hal_pru_generic.h"
+
+
+#define INPUT_MAX_PIN 160           // PRU inputs 0-31, GPIO0-3 32-159
+
+int export_input(hal_pru_generic_t *hpg, int i)
+{
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // Export HAL Pins
+    rtapi_snprintf(name, sizeof(name), "%s.input.%02d.in", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_OUT, &(hpg->input.instance[i].hal.pin.in), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.input.%02d.in-not", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_OUT, &(hpg->input.instance[i].hal.pin.in_not), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.input.%02d.edges", hpg->config.name, i);
+    r = hal_pin_u32_new(name, HAL_OUT, &(hpg->input.instance[i].hal.pin.edges), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Export HAL Parameters
+    rtapi_snprintf(name, sizeof(name), "%s.input.%02d.pin", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->input.instance[i].hal.param.pin), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.input.%02d.debounce", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->input.instance[i].hal.param.debounce), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Initialize HAL Pins
+    *(hpg->input.instance[i].hal.pin.in)     = 0;
+    *(hpg->input.instance[i].hal.pin.in_not) = 1;
+    *(hpg->input.instance[i].hal.pin.edges)  = 0;
+
+    // Initialize HAL Parameters
+    hpg->input.instance[i].hal.param.pin      = PRU_DEFAULT_PIN;
+    hpg->input.instance[i].hal.param.debounce = 0;
+
+    return 0;
+}
+
+int hpg_input_init(hal_pru_generic_t *hpg){
+    int r,i;
+
+    if (hpg->config.num_inputs <= 0)
+        return 0;
+
+    hpg->input.num_instances = hpg->config.num_inputs;
+
+    // Allocate HAL shared memory for input state data
+    hpg->input.instance = (hpg_input_instance_t *) hal_malloc(sizeof(hpg_input_instance_t) * hpg->input.num_instances);
+    if (hpg->input.instance == 0) {
+	HPG_ERR("ERROR: hal_malloc() failed\n");
+	return -1;
+    }
+
+    // Clear memory
+    memset(hpg->input.instance, 0, (sizeof(hpg_input_instance_t) * hpg->input.num_instances) );
+
+    // All inputs share one read task
+    int len = sizeof(hpg->input.pru) + (sizeof(PRU_read_input_t) * hpg->input.num_instances);
+    hpg->input.task.addr = pru_malloc(hpg, len);
+    hpg->input.pru.task.hdr.mode = eMODE_READ;
+
+    pru_task_add(hpg, &(hpg->input.task));
+
+    for (i=0; i < hpg->input.num_instances; i++) {
+        if ((r = export_input(hpg,i)) != 0){ 
+            HPG_ERR("ERROR: failed to export input %i: %i\n",i,r);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Debounce filter of an input: a new level has to be stable for filter + 1
+// PRU periods.  The PRU counts up to filter + 1 in a byte, so filter is at
+// most 254.
+//
+static rtapi_u8 hpg_input_filter(hal_pru_generic_t *hpg, hpg_input_instance_t *in) {
+    rtapi_u32 periods = ceil((double)in->hal.param.debounce / (double)hpg->config.pru_period);
+
+    if (periods > 255) {
+        HPG_ERR("input debounce %d nS too long, clipping to 255 PRU periods\n", in->hal.param.debounce);
+        periods = 255;
+        in->hal.param.debounce = periods * hpg->config.pru_period;
+    }
+
+    return (periods > 0) ? periods - 1 : 0;
+}
+
+void hpg_input_update(hal_pru_generic_t *hpg) {
+    int i;
+    rtapi_u8 gpio_in = 0;
+
+    if (hpg->input.num_instances <= 0) return;
+
+    PRU_read_input_t *pru = (PRU_read_input_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->input.task.addr + sizeof(hpg->input.pru));
+
+    for (i = 0; i < hpg->input.num_instances; i ++) {
+        hpg_input_instance_t *in = &(hpg->input.instance[i]);
+
+        if (in->hal.param.pin >= INPUT_MAX_PIN) {
+            HPG_ERR("input pin %d invalid, allowed 0 to %d, using %d\n", in->hal.param.pin, INPUT_MAX_PIN - 1, PRU_DEFAULT_PIN);
+            in->hal.param.pin = PRU_DEFAULT_PIN;
+        }
+
+        // Only the pin and filter bytes belong to the driver
+        if (in->pru.pin != in->hal.param.pin) {
+            in->pru.pin = in->hal.param.pin;
+            pru[i].pin  = in->pru.pin;
+        }
+
+        rtapi_u8 filter = hpg_input_filter(hpg, in);
+        if (in->pru.filter != filter) {
+            in->pru.filter = filter;
+            pru[i].filter  = in->pru.filter;
+        }
+
+        // The wait task reads the GPIO banks of the inputs at the start of every tick
+        if (in->hal.param.pin >= 32)
+            gpio_in |= 1 << ((in->hal.param.pin >> 5) - 1);
+    }
+
+    hpg->input.gpio_in = gpio_in;
+}
+
+void hpg_input_read(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->input.num_instances <= 0) return;
+
+    PRU_read_input_t *pru = (PRU_read_input_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->input.task.addr + sizeof(hpg->input.pru));
+
+    for (i = 0; i < hpg->input.num_instances; i ++) {
+        hpg_input_instance_t *in = &(hpg->input.instance[i]);
+
+        in->pru.state = pru[i].state;
+        in->pru.edges = pru[i].edges;
+
+        *(in->hal.pin.in)     = in->pru.state & 1;
+        *(in->hal.pin.in_not) = !(in->pru.state & 1);
+        *(in->hal.pin.edges)  = in->pru.edges;
+    }
+}
+
+void hpg_input_force_write(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->input.num_instances <= 0) return;
+
+    hpg->input.pru.task.hdr.mode  = eMODE_READ;
+    hpg->input.pru.task.hdr.len   = hpg->input.num_instances;
+    hpg->input.pru.task.hdr.dataX = 0x00;
+    hpg->input.pru.task.hdr.dataY = 0x00;
+    hpg->input.pru.task.hdr.addr  = hpg->input.task.next;
+
+    hpg->input.pru.pins = 0;
+    memset(hpg->input.pru.gpio, 0, sizeof(hpg->input.pru.gpio));
+
+    PRU_task_read_t *pru = (PRU_task_read_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->input.task.addr);
+    *pru = hpg->input.pru;
+
+    PRU_read_input_t *in = (PRU_read_input_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->input.task.addr + sizeof(hpg->input.pru));
+
+    for (i = 0; i < hpg->input.num_instances; i ++) {
+        hpg->input.instance[i].pru.pin    = hpg->input.instance[i].hal.param.pin;
+        hpg->input.instance[i].pru.filter = hpg_input_filter(hpg, &(hpg->input.instance[i]));
+        hpg->input.instance[i].pru.count  = 0;
+        hpg->input.instance[i].pru.state  = 0;
+        hpg->input.instance[i].pru.edges  = 0;
+        in[i] = hpg->input.instance[i].pru;
+    }
+
+    hpg_input_update(hpg);
+}
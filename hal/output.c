@@ -0,0 +1,196 @@
+//----------------------------------------------------------------------//
+// Description: output.c                                                //
+// Code to interface to the PRU write task, general purpose outputs     //
+//                                                                      //
+// Author(s): Thomas Gerner                                             //
+// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+//                                                                      //
+// Major Changes:                                                       //
+// 2026-Oct    Thomas Gerner                                            //
+//             Initial version, based on pwmgen.c                       //
+//----------------------------------------------------------------------//
+// This file is part of LinuxCNC HAL                                    //
+//                                                                      //
+// Copyright (C) 2026  Thomas Gerner                                    //
+//                                                                      //
+// This program is free software; you can redistribute it and/or        //
+// modify it under the terms of the GNU General Public License          //
+// as published by the Free Software Foundation; either version 2       //
+// of the License, or (at your option) any later version.               //
+//                                                                      //
+// This program is distributed in the hope that it will be useful,      //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+// GNU General Public License for more details.                         //
+//                                                                      //
+// You should have received a copy of the GNU General Public License    //
+// along with this program; if not, write to the Free Software          //
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+// 02110-1301, USA.                                                     //
+//                                                                      //
+// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+// harming persons must have provisions for completely removing power   //
+// from all motors, etc, before persons enter any danger area.  All     //
+// machinery must be designed to comply with local and national safety  //
+// codes, and the authors of this software can not, and do not, take    //
+// any responsibility for such compliance.                              //
+//                                                                      //
+// This code was written as part of the LinuxCNC project.  For more     //
+// information, go to www.linuxcnc.org.                                 //
+//----------------------------------------------------------------------//
+
+#include <rtapi.h>
+#include <rtapi_string.h>
+#include <rtapi_math.h>
+
+#include <hal.h>
+
+#include "hal_pru_generic.h"
+
+
+//
+// Output pins use the SET_CLR_BIT numbering: pin / 32 selects GPIO0-3
+// (0-3) or the PRU outputs (5), pin % 32 the bit
+//
+#define OUTPUT_BANK_PRU 5
+
+int export_output(hal_pru_generic_t *hpg, int i)
+{
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // Export HAL Pins
+    rtapi_snprintf(name, sizeof(name), "%s.output.%02d.out", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_IN, &(hpg->output.instance[i].hal.pin.out), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Export HAL Parameters
+    rtapi_snprintf(name, sizeof(name), "%s.output.%02d.pin", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->output.instance[i].hal.param.pin), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.output.%02d.invert", hpg->config.name, i);
+    r = hal_param_bit_new(name, HAL_RW, &(hpg->output.instance[i].hal.param.invert), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Initialize HAL Pins
+    *(hpg->output.instance[i].hal.pin.out) = 0;
+
+    // Initialize HAL Parameters
+    hpg->output.instance[i].hal.param.pin    = PRU_DEFAULT_PIN;
+    hpg->output.instance[i].hal.param.invert = 0;
+
+    return 0;
+}
+
+int hpg_output_init(hal_pru_generic_t *hpg){
+    int r,i;
+
+    if (hpg->config.num_outputs <= 0)
+        return 0;
+
+    hpg->output.num_instances = hpg->config.num_outputs;
+
+    // Allocate HAL shared memory for output state data
+    hpg->output.instance = (hpg_output_instance_t *) hal_malloc(sizeof(hpg_output_instance_t) * hpg->output.num_instances);
+    if (hpg->output.instance == 0) {
+	HPG_ERR("ERROR: hal_malloc() failed\n");
+	return -1;
+    }
+
+    // Clear memory
+    memset(hpg->output.instance, 0, (sizeof(hpg_output_instance_t) * hpg->output.num_instances) );
+
+    // All outputs share one write task
+    hpg->output.task.addr = pru_malloc(hpg, sizeof(hpg->output.pru));
+    hpg->output.pru.task.hdr.mode = eMODE_WRITE;
+
+    pru_task_add(hpg, &(hpg->output.task));
+
+    for (i=0; i < hpg->output.num_instances; i++) {
+        if ((r = export_output(hpg,i)) != 0){ 
+            HPG_ERR("ERROR: failed to export output %i: %i\n",i,r);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void hpg_output_update(hal_pru_generic_t *hpg) {
+    int i;
+    PRU_write_bank_t bank[OUTPUT_BANK_PRU + 1];
+    PRU_write_bank_t safe[OUTPUT_BANK_PRU + 1];
+
+    if (hpg->output.num_instances <= 0) return;
+
+    memset(bank, 0, sizeof(bank));
+    memset(safe, 0, sizeof(safe));
+
+    // Collect the set and clear masks of all banks
+    for (i = 0; i < hpg->output.num_instances; i ++) {
+        hpg_output_instance_t *out = &(hpg->output.instance[i]);
+        rtapi_u32 b = out->hal.param.pin >> 5;
+
+        if (b > OUTPUT_BANK_PRU || b == 4) {
+            HPG_ERR("output pin %d invalid, using %d\n", out->hal.param.pin, PRU_DEFAULT_PIN);
+            out->hal.param.pin = PRU_DEFAULT_PIN;
+            b = out->hal.param.pin >> 5;
+        }
+
+        if (*(out->hal.pin.out) ^ out->hal.param.invert)
+            bank[b].set |= 1u << (out->hal.param.pin & 31);
+        else
+            bank[b].clr |= 1u << (out->hal.param.pin & 31);
+
+        // While a fault is latched the PRU drives every output off
+        if (out->hal.param.invert)
+            safe[b].set |= 1u << (out->hal.param.pin & 31);
+        else
+            safe[b].clr |= 1u << (out->hal.param.pin & 31);
+    }
+
+    PRU_task_write_t *pru = (PRU_task_write_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->output.task.addr);
+
+    // Only write the PRU when any output changed
+    if (memcmp(hpg->output.pru.gpio, bank, sizeof(hpg->output.pru.gpio)) ||
+        memcmp(&hpg->output.pru.pru, &bank[OUTPUT_BANK_PRU], sizeof(hpg->output.pru.pru))) {
+        memcpy(hpg->output.pru.gpio, bank, sizeof(hpg->output.pru.gpio));
+        hpg->output.pru.pru = bank[OUTPUT_BANK_PRU];
+
+        memcpy(pru->gpio, hpg->output.pru.gpio, sizeof(pru->gpio));
+        pru->pru = hpg->output.pru.pru;
+    }
+
+    if (memcmp(hpg->output.pru.safe_gpio, safe, sizeof(hpg->output.pru.safe_gpio)) ||
+        memcmp(&hpg->output.pru.safe_pru, &safe[OUTPUT_BANK_PRU], sizeof(hpg->output.pru.safe_pru))) {
+        memcpy(hpg->output.pru.safe_gpio, safe, sizeof(hpg->output.pru.safe_gpio));
+        hpg->output.pru.safe_pru = safe[OUTPUT_BANK_PRU];
+
+        memcpy(pru->safe_gpio, hpg->output.pru.safe_gpio, sizeof(pru->safe_gpio));
+        pru->safe_pru = hpg->output.pru.safe_pru;
+    }
+}
+
+void hpg_output_force_write(hal_pru_generic_t *hpg) {
+    if (hpg->output.num_instances <= 0) return;
+
+    hpg->output.pru.task.hdr.mode  = eMODE_WRITE;
+    hpg->output.pru.task.hdr.len   = 0;
+    hpg->output.pru.task.hdr.dataX = 0x00;
+    hpg->output.pru.task.hdr.dataY = 0x00;
+    hpg->output.pru.task.hdr.addr  = hpg->output.task.next;
+
+    // Nothing is written until the first update
+    memset(hpg->output.pru.gpio, 0, sizeof(hpg->output.pru.gpio));
+    memset(&hpg->output.pru.pru, 0, sizeof(hpg->output.pru.pru));
+    memset(hpg->output.pru.safe_gpio, 0, sizeof(hpg->output.pru.safe_gpio));
+    memset(&hpg->output.pru.safe_pru, 0, sizeof(hpg->output.pru.safe_pru));
+
+    PRU_task_write_t *pru = (PRU_task_write_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->output.task.addr);
+    *pru = hpg->output.pru;
+
+    hpg_output_update(hpg);
+}
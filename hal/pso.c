@@ -0,0 +1,344 @@
+//----------------------------------------------------------------------//
+// Description: pso.c                                                   //
+// Code to interface to the PRU position synchronized output task       //
+//                                                                      //
+// Author(s): Thomas Gerner                                             //
+// License: GNU GPL Version 2.0 or (at your option) any later version.  //
+//                                                                      //
+// Major Changes:                                                       //
+// 2026-Oct    Thomas Gerner                                            //
+//             Initial version, based on freq.c                         //
+//----------------------------------------------------------------------//
+// This file is part of LinuxCNC HAL                                    //
+//                                                                      //
+// Copyright (C) 2026  Thomas Gerner                                    //
+//                                                                      //
+// This program is free software; you can redistribute it and/or        //
+// modify it under the terms of the GNU General Public License          //
+// as published by the Free Software Foundation; either version 2       //
+// of the License, or (at your option) any later version.               //
+//                                                                      //
+// This program is distributed in the hope that it will be useful,      //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of       //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        //
+// GNU General Public License for more details.                         //
+//                                                                      //
+// You should have received a copy of the GNU General Public License    //
+// along with this program; if not, write to the Free Software          //
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA        //
+// 02110-1301, USA.                                                     //
+//                                                                      //
+// THE AUTHORS OF THIS PROGRAM ACCEPT ABSOLUTELY NO LIABILITY FOR       //
+// ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE   //
+// TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of      //
+// harming persons must have provisions for completely removing power   //
+// from all motors, etc, before persons enter any danger area.  All     //
+// machinery must be designed to comply with local and national safety  //
+// codes, and the authors of this software can not, and do not, take    //
+// any responsibility for such compliance.                              //
+//                                                                      //
+// This code was written as part of the LinuxCNC project.  For more     //
+// information, go to www.linuxcnc.org.                                 //
+//----------------------------------------------------------------------//
+
+
+#include <rtapi.h>
+#include <rtapi_string.h>
+#include <rtapi_math.h>
+
+#include <hal.h>
+
+#include "hal_pru_generic.h"
+
+
+#define PSO_BANK_PRU    5           // pins 160-191, bank 4 (128-159) has no outputs
+
+int export_pso(hal_pru_generic_t *hpg, int i)
+{
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // Export HAL Pins
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.enable", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_IN, &(hpg->pso.instance[i].hal.pin.enable), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.start", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_IN, &(hpg->pso.instance[i].hal.pin.start), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.spacing", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_IN, &(hpg->pso.instance[i].hal.pin.spacing), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.count", hpg->config.name, i);
+    r = hal_pin_u32_new(name, HAL_IN, &(hpg->pso.instance[i].hal.pin.count), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.fired", hpg->config.name, i);
+    r = hal_pin_u32_new(name, HAL_OUT, &(hpg->pso.instance[i].hal.pin.fired), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.pending", hpg->config.name, i);
+    r = hal_pin_u32_new(name, HAL_OUT, &(hpg->pso.instance[i].hal.pin.pending), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.done", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_OUT, &(hpg->pso.instance[i].hal.pin.done), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Export HAL Parameters
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.pin", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->pso.instance[i].hal.param.pin), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.invert", hpg->config.name, i);
+    r = hal_param_bit_new(name, HAL_RW, &(hpg->pso.instance[i].hal.param.invert), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.pulse-width", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->pso.instance[i].hal.param.pulse_width), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.source", hpg->config.name, i);
+    r = hal_param_s32_new(name, HAL_RW, &(hpg->pso.instance[i].hal.param.source), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    rtapi_snprintf(name, sizeof(name), "%s.pso.%02d.source-encoder", hpg->config.name, i);
+    r = hal_param_bit_new(name, HAL_RW, &(hpg->pso.instance[i].hal.param.source_encoder), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    // Initialize HAL Pins
+    *(hpg->pso.instance[i].hal.pin.enable)  = 0;
+    *(hpg->pso.instance[i].hal.pin.start)   = 0.0;
+    *(hpg->pso.instance[i].hal.pin.spacing) = 0.0;
+    *(hpg->pso.instance[i].hal.pin.count)   = 0;
+    *(hpg->pso.instance[i].hal.pin.fired)   = 0;
+    *(hpg->pso.instance[i].hal.pin.pending) = 0;
+    *(hpg->pso.instance[i].hal.pin.done)    = 0;
+
+    // Initialize HAL Parameters
+    hpg->pso.instance[i].hal.param.pin            = PRU_DEFAULT_PIN;
+    hpg->pso.instance[i].hal.param.invert         = 0;
+    hpg->pso.instance[i].hal.param.pulse_width    = 0;
+    hpg->pso.instance[i].hal.param.source         = -1;
+    hpg->pso.instance[i].hal.param.source_encoder = 0;
+
+    return 0;
+}
+
+int hpg_pso_init(hal_pru_generic_t *hpg){
+    int r,i;
+
+    if (hpg->config.num_psos <= 0)
+        return 0;
+
+    hpg->pso.num_instances = hpg->config.num_psos;
+
+    // Allocate HAL shared memory for position synchronized output state data
+    hpg->pso.instance = (hpg_pso_instance_t *) hal_malloc(sizeof(hpg_pso_instance_t) * hpg->pso.num_instances);
+    if (hpg->pso.instance == 0) {
+	HPG_ERR("ERROR: hal_malloc() failed\n");
+	return -1;
+    }
+
+    // Clear memory
+    memset(hpg->pso.instance, 0, (sizeof(hpg_pso_instance_t) * hpg->pso.num_instances) );
+
+    // One task per output, added after the stepgen and encoder tasks so the
+    // positions compared are the ones of the current tick
+    for (i=0; i < hpg->pso.num_instances; i++) {
+        hpg->pso.instance[i].task.addr = pru_malloc(hpg, sizeof(hpg->pso.instance[i].pru));
+        hpg->pso.instance[i].pru.task.hdr.mode = eMODE_PSO;
+
+        pru_task_add(hpg, &(hpg->pso.instance[i].task));
+
+        if ((r = export_pso(hpg,i)) != 0){ 
+            HPG_ERR("ERROR: failed to export pso %i: %i\n",i,r);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// PRU address of the watched position, and the scale and offset from machine
+// units to the raw PRU count.  The PRU stepgen Pos is the stepgen counts, the
+// PRU encoder count is the encoder rawcounts.  Returns 0 if there is no source.
+//
+static pru_addr_t hpg_pso_source(hal_pru_generic_t *hpg, hpg_pso_instance_t *p, double *scale, double *offset) {
+    hpg_encoder_channel_instance_t *e;
+
+    *scale  = 1.0;
+    *offset = 0.0;
+
+    if (p->hal.param.source < 0) return 0;
+
+    if (p->hal.param.source_encoder) {
+        e = hpg_encoder_channel(hpg, p->hal.param.source);
+        if (e == 0) return 0;
+
+        *scale  = e->hal.param.scale;
+        *offset = e->zero_offset;
+        return hpg_encoder_count_addr(hpg, p->hal.param.source);
+    }
+
+    if (p->hal.param.source >= hpg->stepgen.num_instances) return 0;
+
+    *scale = hpg->stepgen.instance[p->hal.param.source].hal.param.position_scale;
+    return hpg->stepgen.instance[p->hal.param.source].task.addr + offsetof(PRU_task_stepgen_t, pos);
+}
+
+//
+// Pulse length in PRU periods, 0 toggles the output at every position
+//
+static rtapi_u16 hpg_pso_width(hal_pru_generic_t *hpg, hpg_pso_instance_t *p) {
+    rtapi_u32 periods = ceil((double)p->hal.param.pulse_width / (double)hpg->config.pru_period);
+
+    if (periods > 0xFFFF) {
+        HPG_ERR("pso pulse-width %d nS too long, clipping to 65535 PRU periods\n", p->hal.param.pulse_width);
+        periods = 0xFFFF;
+        p->hal.param.pulse_width = periods * hpg->config.pru_period;
+    }
+
+    return periods;
+}
+
+//
+// Queue the next positions into the free table entries, the PRU moves head
+// as it passes them
+//
+static void hpg_pso_refill(hpg_pso_instance_t *p, PRU_task_pso_t *pru, rtapi_u8 head, double scale, double offset) {
+    rtapi_u32 limit = *(p->hal.pin.count);
+    double raw;
+
+    if (*(p->hal.pin.spacing) == 0.0)
+        limit = 1;
+
+    while ((limit == 0 || p->queued < limit) && ((p->pru.tail + 1) & (PSO_TABLE_SIZE - 1)) != head) {
+        raw = (*(p->hal.pin.start) + p->queued * *(p->hal.pin.spacing)) * scale + offset;
+        if (raw > RTAPI_INT32_MAX) raw = RTAPI_INT32_MAX;
+        if (raw < RTAPI_INT32_MIN) raw = RTAPI_INT32_MIN;
+
+        pru->table[p->pru.tail] = floor(raw + 0.5);
+        p->pru.tail = (p->pru.tail + 1) & (PSO_TABLE_SIZE - 1);
+        p->queued++;
+    }
+
+    // The entries have to be in place before the PRU sees the new tail
+    pru->tail = p->pru.tail;
+}
+
+void hpg_pso_update(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->pso.num_instances <= 0) return;
+
+    for (i = 0; i < hpg->pso.num_instances; i ++) {
+        hpg_pso_instance_t *p = &(hpg->pso.instance[i]);
+        PRU_task_pso_t *pru = (PRU_task_pso_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) p->task.addr);
+        rtapi_u32 b = p->hal.param.pin >> 5;
+        pru_addr_t src_addr;
+        double scale, offset;
+        rtapi_u16 width;
+        rtapi_u8 head;
+        int enable;
+
+        if (b > PSO_BANK_PRU || b == 4) {
+            HPG_ERR("pso pin %d invalid, using %d\n", p->hal.param.pin, PRU_DEFAULT_PIN);
+            p->hal.param.pin = PRU_DEFAULT_PIN;
+        }
+
+        if (p->pru.task.hdr.dataX != p->hal.param.pin) {
+            p->pru.task.hdr.dataX = p->hal.param.pin;
+            pru->task.hdr.dataX = p->pru.task.hdr.dataX;
+        }
+
+        width = hpg_pso_width(hpg, p);
+        if (p->pru.width != width || p->pru.invert != p->hal.param.invert) {
+            p->pru.width  = width;
+            p->pru.invert = p->hal.param.invert;
+            pru->width  = p->pru.width;
+            pru->invert = p->pru.invert;
+        }
+
+        src_addr = hpg_pso_source(hpg, p, &scale, &offset);
+        if (p->hal.param.source != p->written_source || p->hal.param.source_encoder != p->written_source_encoder) {
+            if (src_addr == 0 && p->hal.param.source >= 0) {
+                HPG_ERR("pso.%02d.source %s %d does not exist, pso disabled\n", i,
+                    p->hal.param.source_encoder ? "encoder" : "stepgen", p->hal.param.source);
+            }
+            p->written_source = p->hal.param.source;
+            p->written_source_encoder = p->hal.param.source_encoder;
+        }
+        if (src_addr != p->pru.src_addr) {
+            p->pru.src_addr = src_addr;
+            pru->src_addr = p->pru.src_addr;
+        }
+
+        // After a fault the output stays disabled until enable is cleared
+        if (!*(p->hal.pin.enable))
+            p->rearm = 0;
+        enable = *(p->hal.pin.enable) && src_addr != 0 && !p->rearm;
+
+        head = pru->head;
+
+        if (!enable) {
+            // The PRU drops the queued positions
+            p->queued = 0;
+        } else if (!p->enabled) {
+            // Just enabled, the PRU may still drop entries written now, so
+            // the first positions are queued by the next update
+            p->queued = 0;
+            p->fired_base = pru->fired;
+        } else {
+            hpg_pso_refill(p, pru, head, scale, offset);
+        }
+
+        if (p->pru.flags != (enable ? PRU_PSO_ENABLE : 0)) {
+            p->pru.flags = enable ? PRU_PSO_ENABLE : 0;
+            pru->flags = p->pru.flags;
+        }
+        p->enabled = enable;
+
+        if (enable) {
+            rtapi_u32 limit = (*(p->hal.pin.spacing) == 0.0) ? 1 : *(p->hal.pin.count);
+
+            *(p->hal.pin.fired)   = pru->fired - p->fired_base;
+            *(p->hal.pin.pending) = (p->pru.tail - head) & (PSO_TABLE_SIZE - 1);
+            *(p->hal.pin.done)    = limit != 0 && p->queued >= limit && head == p->pru.tail;
+        } else {
+            *(p->hal.pin.pending) = 0;
+            *(p->hal.pin.done)    = 0;
+        }
+    }
+}
+
+void hpg_pso_force_write(hal_pru_generic_t *hpg) {
+    int i;
+
+    if (hpg->pso.num_instances <= 0) return;
+
+    for (i = 0; i < hpg->pso.num_instances; i ++) {
+        hpg_pso_instance_t *p = &(hpg->pso.instance[i]);
+        PRU_task_pso_t *pru = (PRU_task_pso_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) p->task.addr);
+
+        memset(&(p->pru), 0, sizeof(p->pru));
+        p->pru.task.hdr.mode  = eMODE_PSO;
+        p->pru.task.hdr.len   = 0;
+        p->pru.task.hdr.dataX = p->hal.param.pin;
+        p->pru.task.hdr.dataY = 0x00;
+        p->pru.task.hdr.addr  = p->task.next;
+        *pru = p->pru;
+
+        p->enabled    = 0;
+        p->rearm      = 0;
+        p->queued     = 0;
+        p->fired_base = 0;
+        p->written_source = -1;
+        p->written_source_encoder = 0;
+    }
+
+    hpg_pso_update(hpg);
+}
@@ -58,17 +58,31 @@
 
 #include "hal_pru_generic.h"
 
+//
+// The PRU task only walks its outputs when the prescaler expires, so a slow
+// PWM with a limited resolution costs next to nothing in the other ticks.
+//
 void hpg_pwmgen_handle_pwm_period(hal_pru_generic_t *hpg, int i) {
     rtapi_u32 pwm_pru_periods;
+    rtapi_u32 prescale = 1;
+    rtapi_u32 resolution = hpg->pwmgen.instance[i].hal.param.pwm_resolution;
+
     pwm_pru_periods = (double) hpg->pwmgen.instance[i].hal.param.pwm_period / hpg->config.pru_period;
-    if (pwm_pru_periods < 65535) {
-        hpg->pwmgen.instance[i].pru.prescale = 1;
-        hpg->pwmgen.instance[i].pru.period = pwm_pru_periods - 1;
-    } else {
+    if (pwm_pru_periods < 1) pwm_pru_periods = 1;
+
+    if (pwm_pru_periods >= 65535) {
         // prescale required
-        hpg->pwmgen.instance[i].pru.prescale = ceil((double) pwm_pru_periods / 65535.0);
-        hpg->pwmgen.instance[i].pru.period = (pwm_pru_periods / hpg->pwmgen.instance[i].pru.prescale) - 1;
+        prescale = ceil((double) pwm_pru_periods / 65535.0);
+    }
+
+    if (resolution > 0 && pwm_pru_periods / resolution > prescale) {
+        prescale = pwm_pru_periods / resolution;
     }
+
+    if (prescale > 65535) prescale = 65535;
+
+    hpg->pwmgen.instance[i].pru.prescale = prescale;
+    hpg->pwmgen.instance[i].pru.period = (pwm_pru_periods / prescale) - 1;
 }
 
 int export_pwmgen(hal_pru_generic_t *hpg, int i)
@@ -83,6 +97,12 @@ int export_pwmgen(hal_pru_generic_t *hpg, int i)
 
     hpg->pwmgen.instance[i].hal.param.pwm_period = 10000000;    // Default to 10 mS period, or 100 Hz
 
+    rtapi_snprintf(name, sizeof(name), "%s.pwmgen.%02d.pwm_resolution", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->pwmgen.instance[i].hal.param.pwm_resolution), hpg->config.comp_id);
+    if (r != 0) { return r; }
+
+    hpg->pwmgen.instance[i].hal.param.pwm_resolution = 0;       // Default to one step per PRU period
+
     for (j=0; j < hpg->pwmgen.instance[i].num_outputs; j++) {
         // Export HAL Pins
         rtapi_snprintf(name, sizeof(name), "%s.pwmgen.%02d.out.%02d.enable", hpg->config.name, i, j);
@@ -120,9 +140,7 @@ int hpg_pwmgen_init(hal_pru_generic_t *hpg){
     if (hpg->config.num_pwmgens <= 0)
         return 0;
 
-    // FIXME: Support multiple PWMs like so:  num_pwmgens=3,4,2,5
-    // hpg->pwmgen.num_instances = hpg->config.num_pwmgens;
-    hpg->pwmgen.num_instances = 1;
+    hpg->pwmgen.num_instances = hpg->config.num_pwmgens;
 
     // Allocate HAL shared memory for instance state data
     hpg->pwmgen.instance = (hpg_pwmgen_instance_t *) hal_malloc(sizeof(hpg_pwmgen_instance_t) * hpg->pwmgen.num_instances);
@@ -136,8 +154,7 @@ int hpg_pwmgen_init(hal_pru_generic_t *hpg){
 
     for (i=0; i < hpg->pwmgen.num_instances; i++) {
 
-        // FIXME: Support multiple PWMs like so:  num_pwmgens=3,4,2,5
-        hpg->pwmgen.instance[i].num_outputs = hpg->config.num_pwmgens;
+        hpg->pwmgen.instance[i].num_outputs = hpg->config.pwmgen_outputs[i];
 
         // Allocate HAL shared memory for output state data
         hpg->pwmgen.instance[i].out = (hpg_pwmgen_output_instance_t *) hal_malloc(sizeof(hpg_pwmgen_output_instance_t) * hpg->pwmgen.instance[i].num_outputs);
@@ -146,8 +163,12 @@ int hpg_pwmgen_init(hal_pru_generic_t *hpg){
 	        return -1;
         }
 
-        int len = sizeof(hpg->pwmgen.instance[i].pru) + (sizeof(PRU_pwm_output_t) * hpg->pwmgen.instance[i].num_outputs);
+        // Two output tables, each with an end entry
+        int table_len = sizeof(PRU_pwm_output_t) * (hpg->pwmgen.instance[i].num_outputs + 1);
+        int len = sizeof(hpg->pwmgen.instance[i].pru) + 2 * table_len;
         hpg->pwmgen.instance[i].task.addr = pru_malloc(hpg, len);
+        hpg->pwmgen.instance[i].table[0] = sizeof(hpg->pwmgen.instance[i].pru);
+        hpg->pwmgen.instance[i].table[1] = sizeof(hpg->pwmgen.instance[i].pru) + table_len;
         hpg->pwmgen.instance[i].pru.task.hdr.mode = eMODE_PWM;
 
         pru_task_add(hpg, &(hpg->pwmgen.instance[i].task));
@@ -162,45 +183,103 @@ int hpg_pwmgen_init(hal_pru_generic_t *hpg){
     return 0;
 }
 
+//
+// Compute the PRU values of all outputs, returns nonzero if any changed
+//
+static int hpg_pwmgen_compute(hal_pru_generic_t *hpg, int i) {
+    int j, changed = 0;
+    double scaled_value;
+    double abs_duty_cycle;
+    PRU_pwm_output_t value;
+
+    for (j = 0; j < hpg->pwmgen.instance[i].num_outputs ; j ++) {
+
+        value.pin = hpg->pwmgen.instance[i].out[j].hal.param.pin;
+        value.reserved = 0;
+
+        if (*hpg->pwmgen.instance[i].out[j].hal.pin.enable == 0) {
+            value.value = 0;
+        } else {
+            scaled_value = *hpg->pwmgen.instance[i].out[j].hal.pin.value / hpg->pwmgen.instance[i].out[j].hal.param.scale;
+
+            abs_duty_cycle = fabs(scaled_value);
+            if (abs_duty_cycle > 1.0) abs_duty_cycle = 1.0;
+
+            // duty_cycle goes from 0.0 to 1.0, and needs to be cover the range of 0 to pwm_period, inclusive
+            value.value = abs_duty_cycle * (double)(hpg->pwmgen.instance[i].pru.period + 1);
+        }
+
+        if (value.value != hpg->pwmgen.instance[i].out[j].pru.value ||
+            value.pin != hpg->pwmgen.instance[i].out[j].pru.pin) {
+            hpg->pwmgen.instance[i].out[j].pru = value;
+            changed = 1;
+        }
+    }
+
+    return changed;
+}
+
+//
+// Write the outputs sorted by value into one of the PRU output tables, so
+// the PRU only has to look at the next clear edge each period
+//
+static void hpg_pwmgen_write_table(hal_pru_generic_t *hpg, int i, rtapi_u16 table) {
+    int j, k;
+    PRU_pwm_output_t *out = (PRU_pwm_output_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pwmgen.instance[i].task.addr + table);
+    PRU_pwm_output_t value;
+
+    // Insertion sort, the number of outputs is small
+    for (j = 0; j < hpg->pwmgen.instance[i].num_outputs ; j ++) {
+        value = hpg->pwmgen.instance[i].out[j].pru;
+        for (k = j; k > 0 && out[k-1].value > value.value; k--) {
+            out[k] = out[k-1];
+        }
+        out[k] = value;
+    }
+
+    out[j].value = PWM_TABLE_END;
+    out[j].pin = PRU_DEFAULT_PIN;
+    out[j].reserved = 0;
+}
+
 void hpg_pwmgen_update(hal_pru_generic_t *hpg) {
-    int i, j;
+    int i;
+    rtapi_u16 table;
 
     if (hpg->pwmgen.num_instances <= 0) return;
 
     for (i = 0; i < hpg->pwmgen.num_instances; i ++) {
-        double scaled_value;
-        double abs_duty_cycle;
+        PRU_task_pwm_t *pru = (PRU_task_pwm_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pwmgen.instance[i].task.addr);
 
-        if (hpg->pwmgen.instance[i].written_pwm_period != hpg->pwmgen.instance[i].hal.param.pwm_period) {
+        if (hpg->pwmgen.instance[i].written_pwm_period != hpg->pwmgen.instance[i].hal.param.pwm_period ||
+            hpg->pwmgen.instance[i].written_pwm_resolution != hpg->pwmgen.instance[i].hal.param.pwm_resolution) {
             hpg_pwmgen_handle_pwm_period(hpg, i);
             hpg->pwmgen.instance[i].written_pwm_period = hpg->pwmgen.instance[i].hal.param.pwm_period;
-            PRU_task_pwm_t *pru = (PRU_task_pwm_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pwmgen.instance[i].task.addr);
+            hpg->pwmgen.instance[i].written_pwm_resolution = hpg->pwmgen.instance[i].hal.param.pwm_resolution;
             pru->prescale = hpg->pwmgen.instance[i].pru.prescale;
             pru->period   = hpg->pwmgen.instance[i].pru.period;
         }
 
-        PRU_pwm_output_t *out = (PRU_pwm_output_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pwmgen.instance[i].task.addr + sizeof(hpg->pwmgen.instance[i].pru));
+        if (hpg_pwmgen_compute(hpg, i))
+            hpg->pwmgen.instance[i].table_dirty = 1;
 
-        for (j = 0; j < hpg->pwmgen.instance[i].num_outputs ; j ++) {
+        if (!hpg->pwmgen.instance[i].table_dirty)
+            continue;
 
-            if (*hpg->pwmgen.instance[i].out[j].hal.pin.enable == 0) {
-                hpg->pwmgen.instance[i].out[j].pru.value = 0;
-                continue;
-            }
+        // The PRU has not yet switched to the table written last time, so
+        // both tables may still be in use.  Try again on the next update.
+        if (pru->active != hpg->pwmgen.instance[i].pru.table)
+            continue;
 
-            scaled_value = *hpg->pwmgen.instance[i].out[j].hal.pin.value / hpg->pwmgen.instance[i].out[j].hal.param.scale;
-
-            abs_duty_cycle = fabs(scaled_value);
-            if (abs_duty_cycle > 1.0) abs_duty_cycle = 1.0;
-
-            // duty_cycle goes from 0.0 to 1.0, and needs to be cover the range of 0 to pwm_period, inclusive
-            hpg->pwmgen.instance[i].out[j].pru.value = abs_duty_cycle * (double)(hpg->pwmgen.instance[i].pru.period + 1);
-
-            hpg->pwmgen.instance[i].out[j].pru.pin = hpg->pwmgen.instance[i].out[j].hal.param.pin;
-
-            out[j] = hpg->pwmgen.instance[i].out[j].pru;
-        }
+        if (hpg->pwmgen.instance[i].pru.table == hpg->pwmgen.instance[i].table[0])
+            table = hpg->pwmgen.instance[i].table[1];
+        else
+            table = hpg->pwmgen.instance[i].table[0];
 
+        hpg_pwmgen_write_table(hpg, i, table);
+        hpg->pwmgen.instance[i].pru.table = table;
+        pru->table = table;
+        hpg->pwmgen.instance[i].table_dirty = 0;
     }
 }
 
@@ -219,8 +298,20 @@ void hpg_pwmgen_force_write(hal_pru_generic_t *hpg) {
 
         hpg_pwmgen_handle_pwm_period(hpg, i);
         hpg->pwmgen.instance[i].written_pwm_period = hpg->pwmgen.instance[i].hal.param.pwm_period;
+        hpg->pwmgen.instance[i].written_pwm_resolution = hpg->pwmgen.instance[i].hal.param.pwm_resolution;
 
         hpg->pwmgen.instance[i].pru.reserved = 0;
+        hpg->pwmgen.instance[i].pru.t_prescale = 0;
+        hpg->pwmgen.instance[i].pru.t_period = 0;
+
+        // Start with the first table, already in use by the PRU
+        hpg_pwmgen_compute(hpg, i);
+        hpg_pwmgen_write_table(hpg, i, hpg->pwmgen.instance[i].table[0]);
+        hpg->pwmgen.instance[i].table_dirty = 0;
+
+        hpg->pwmgen.instance[i].pru.table  = hpg->pwmgen.instance[i].table[0];
+        hpg->pwmgen.instance[i].pru.active = hpg->pwmgen.instance[i].table[0];
+        hpg->pwmgen.instance[i].pru.next   = hpg->pwmgen.instance[i].table[0];
 
         PRU_task_pwm_t *pru = (PRU_task_pwm_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) hpg->pwmgen.instance[i].task.addr);
         *pru = hpg->pwmgen.instance[i].pru;
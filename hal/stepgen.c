@@ -60,6 +60,12 @@
 #include "hal_pru_generic.h"
 
 #define MAX_CYCLE 8
+
+// Sine table for the microstep class: one electrical cycle (4 full steps) in
+// 256 entries, magnitude 0 to MICRO_FULL_SCALE, bit 15 holds the sign
+#define MICRO_TABLE_LEN     256
+#define MICRO_FULL_SCALE    0x4000
+#define MICRO_SIGN          0x8000
 #define f_period_s ((double)(l_period_ns * 1e-9))
 
 /*
@@ -80,11 +86,19 @@ static unsigned char master_lut[][MAX_CYCLE] = {
 // local function prototypes
 static int export_stepdir(hal_pru_generic_t *hpg, int i);
 static int export_stepphase(hal_pru_generic_t *hpg, int i);
+static int export_stepcl(hal_pru_generic_t *hpg, int i);
+static int export_stepmicro(hal_pru_generic_t *hpg, int i);
+static int export_stepgear(hal_pru_generic_t *hpg, int i);
 
 static void hpg_stepdir_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru);
 static void hpg_stepphase_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru);
+static void hpg_stepcl_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru);
+static void hpg_stepmicro_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru);
+static void hpg_stepgear_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru);
 
 static rtapi_u32 create_lut(hpg_stepgen_instance_t *instance);
+static rtapi_u8 create_microstep_mask(hpg_stepgen_instance_t *instance);
+static void write_sine_table(hal_pru_generic_t *hpg);
 
 
 // Start out with default pulse length/width and setup/hold delays of 1 mS (1000000 nS) 
@@ -118,16 +132,17 @@ void hpg_stepgen_read(hal_pru_generic_t *hpg, long l_period_ns) {
         hpg->stepgen.instance[i].pru.accum = x & 0xFFFFFFFF;
         hpg->stepgen.instance[i].pru.pos   = x >> 32;
 
-        *(hpg->stepgen.instance[i].hal.pin.test1) = hpg->stepgen.instance[i].pru.accum;
-        *(hpg->stepgen.instance[i].hal.pin.test2) = hpg->stepgen.instance[i].pru.pos;
-
         // Mangle 32-bit step count and 27 bit accumulator (with 5 bits of status)
         // into a 16.16 value to match the hostmot2 stepgen logic and generally make
         // things less confusing
         acc  = (hpg->stepgen.instance[i].pru.accum >> 11) & 0x0000FFFF;
         acc |= (hpg->stepgen.instance[i].pru.pos << 16);
 
-        *(hpg->stepgen.instance[i].hal.pin.test3) = acc;
+        if (hpg->config.debug) {
+            *(hpg->stepgen.instance[i].hal.pin.test1) = hpg->stepgen.instance[i].pru.accum;
+            *(hpg->stepgen.instance[i].hal.pin.test2) = hpg->stepgen.instance[i].pru.pos;
+            *(hpg->stepgen.instance[i].hal.pin.test3) = acc;
+        }
 
         // those tricky users are always trying to get us to divide by zero
         if (fabs(hpg->stepgen.instance[i].hal.param.position_scale) < 1e-6) {
@@ -162,6 +177,37 @@ void hpg_stepgen_read(hal_pru_generic_t *hpg, long l_period_ns) {
 
         hpg->stepgen.instance[i].prev_accumulator = acc;
 
+        if (hpg->config.step_class[i] == eCLASS_STEP_DIR_CL) {
+            PRU_stepgen_cl_t *pru_cl = (PRU_stepgen_cl_t *) ((rtapi_u32) hpg->pru_data + hpg->stepgen.instance[i].task.addr + sizeof(PRU_task_stepgen_t));
+
+            hpg->stepgen.instance[i].pru_cl.corrections = pru_cl->corrections;
+            hpg->stepgen.instance[i].pru_cl.ferror      = pru_cl->ferror;
+
+            *(hpg->stepgen.instance[i].hal.pin.correction_steps) = hpg->stepgen.instance[i].pru_cl.corrections;
+
+            // following error is reported in encoder counts, convert to machine units
+            if (hpg->stepgen.instance[i].hal.param.cl.counts_per_step != 0.0) {
+                *(hpg->stepgen.instance[i].hal.pin.following_error) = (double)hpg->stepgen.instance[i].pru_cl.ferror
+                    / hpg->stepgen.instance[i].hal.param.cl.counts_per_step / hpg->stepgen.instance[i].hal.param.position_scale;
+            } else {
+                *(hpg->stepgen.instance[i].hal.pin.following_error) = 0.0;
+            }
+        }
+
+        if (hpg->config.step_class[i] == eCLASS_STEP_GEAR) {
+            hpg_stepgen_instance_t *s = &(hpg->stepgen.instance[i]);
+            PRU_stepgen_gear_t *pru_gear = (PRU_stepgen_gear_t *) ((rtapi_u32) hpg->pru_data + s->task.addr + sizeof(PRU_task_stepgen_t));
+
+            s->pru_gear.eff_ratio = pru_gear->eff_ratio;
+            s->pru_gear.error     = pru_gear->error;
+
+            // sync error is reported in 16.16 steps, convert to machine units
+            *(s->hal.pin.gear_sync_error) = ((double)s->pru_gear.error / 65536.0) / s->hal.param.position_scale;
+
+            // locked once the ramp is done and the steps are within one step of the target
+            *(s->hal.pin.gear_locked) = (s->pru_gear.flags & PRU_STEPGEAR_ENABLE) && s->pru_gear.eff_ratio == s->pru_gear.ratio
+                && s->pru_gear.error > -65536 && s->pru_gear.error < 65536;
+        }
     }
 }
 
@@ -184,16 +230,18 @@ static void hpg_stepgen_instance_position_control(hal_pru_generic_t *hpg, long l
 
     hpg_stepgen_instance_t *s = &hpg->stepgen.instance[i];
 
-    *(s->hal.pin.dbg_pos_minus_prev_cmd) = *(s->hal.pin.position_fb) - s->old_position_cmd;
-
     // calculate feed-forward velocity in machine units per second
     ff_vel = (*(s->hal.pin.position_cmd) - s->old_position_cmd) / f_period_s;
-    *(s->hal.pin.dbg_ff_vel) = ff_vel;
-
-    s->old_position_cmd = *(s->hal.pin.position_cmd);
 
     velocity_error = *(s->hal.pin.velocity_fb) - ff_vel;
-    *(s->hal.pin.dbg_vel_error) = velocity_error;
+
+    if (hpg->config.debug) {
+        *(s->hal.pin.dbg_pos_minus_prev_cmd) = *(s->hal.pin.position_fb) - s->old_position_cmd;
+        *(s->hal.pin.dbg_ff_vel) = ff_vel;
+        *(s->hal.pin.dbg_vel_error) = velocity_error;
+    }
+
+    s->old_position_cmd = *(s->hal.pin.position_cmd);
 
     // Do we need to change speed to match the speed of position-cmd?
     // If maxaccel is 0, there's no accel limit: fix this velocity error
@@ -223,7 +271,6 @@ static void hpg_stepgen_instance_position_control(hal_pru_generic_t *hpg, long l
     } else {
         seconds_to_vel_match = -velocity_error / match_accel;
     }
-    *(s->hal.pin.dbg_s_to_match) = seconds_to_vel_match;
 
     // compute expected position at the time of velocity match
     // Note: this is "feedback position at the beginning of the servo period after we attain velocity match"
@@ -237,7 +284,10 @@ static void hpg_stepgen_instance_position_control(hal_pru_generic_t *hpg, long l
     position_cmd_at_match = *s->hal.pin.position_cmd + (ff_vel * seconds_to_vel_match);
     error_at_match = position_at_match - position_cmd_at_match;
 
-    *s->hal.pin.dbg_err_at_match = error_at_match;
+    if (hpg->config.debug) {
+        *(s->hal.pin.dbg_s_to_match) = seconds_to_vel_match;
+        *(s->hal.pin.dbg_err_at_match) = error_at_match;
+    }
 
     if (seconds_to_vel_match < f_period_s) {
         // we can match velocity in one period
@@ -304,10 +354,13 @@ static void update_stepgen(hal_pru_generic_t *hpg, long l_period_ns, int i) {
     {
         double min_ns_per_step, max_steps_per_s;
 
-        if (mode == eMODE_STEP_DIR) {
+        if (mode == eMODE_STEP_DIR || mode == eMODE_STEP_DIR_CL || mode == eMODE_UP_DOWN || mode == eMODE_STEP_GEAR) {
             min_ns_per_step = (s->pru.steplen + s->pru.stepspace) * hpg->config.pru_period;
         } else if (mode == eMODE_STEP_PHASE || mode == eMODE_EDGESTEP_DIR) {
             min_ns_per_step = s->pru.steplen * hpg->config.pru_period;
+        } else {
+            // microstep: the DDS rate is limited to half a full step per period
+            min_ns_per_step = 2 * hpg->config.pru_period;
         }
         max_steps_per_s = 1.0e9 / min_ns_per_step;
 
@@ -372,7 +425,9 @@ static void update_stepgen(hal_pru_generic_t *hpg, long l_period_ns, int i) {
         s->pru.rate = 0xFC000001;
     }
 
-    *s->hal.pin.dbg_step_rate = s->pru.rate;
+    if (hpg->config.debug) {
+        *s->hal.pin.dbg_step_rate = s->pru.rate;
+    }
 }
 
 int export_stepgen(hal_pru_generic_t *hpg, int i)
@@ -430,69 +485,70 @@ int export_stepgen(hal_pru_generic_t *hpg, int i)
         return r;
     }
 
-    // debug pins
-
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_pos_minus_prev_cmd", hpg->config.name, i);
-    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_pos_minus_prev_cmd), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+    // debug pins, only exported on request
+    if (hpg->config.debug) {
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_pos_minus_prev_cmd", hpg->config.name, i);
+        r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_pos_minus_prev_cmd), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_ff_vel", hpg->config.name, i);
-    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_ff_vel), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_ff_vel", hpg->config.name, i);
+        r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_ff_vel), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_s_to_match", hpg->config.name, i);
-    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_s_to_match), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_s_to_match", hpg->config.name, i);
+        r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_s_to_match), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_vel_error", hpg->config.name, i);
-    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_vel_error), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_vel_error", hpg->config.name, i);
+        r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_vel_error), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_err_at_match", hpg->config.name, i);
-    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_err_at_match), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_err_at_match", hpg->config.name, i);
+        r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_err_at_match), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_step_rate", hpg->config.name, i);
-    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_step_rate), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dbg_step_rate", hpg->config.name, i);
+        r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.dbg_step_rate), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test1", hpg->config.name, i);
-    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test1), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test1", hpg->config.name, i);
+        r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test1), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test2", hpg->config.name, i);
-    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test2), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
-    }
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test2", hpg->config.name, i);
+        r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test2), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test3", hpg->config.name, i);
-    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test3), hpg->config.comp_id);
-    if (r < 0) {
-        HPG_ERR("Error adding pin '%s', aborting\n", name);
-        return r;
+        rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.test3", hpg->config.name, i);
+        r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.test3), hpg->config.comp_id);
+        if (r < 0) {
+            HPG_ERR("Error adding pin '%s', aborting\n", name);
+            return r;
+        }
     }
 
     // Parameters
@@ -574,8 +630,11 @@ int export_stepgen(hal_pru_generic_t *hpg, int i)
 static int export_stepdir(hal_pru_generic_t *hpg, int i) {
     char name[HAL_NAME_LEN + 1];
     int r;
+    // up/down has no direction output, its two pins carry the up and down pulses
+    int updown = (hpg->config.step_class[i] == eCLASS_STEP_UP_DOWN);
 
-    if (hpg->config.step_class[i] == eCLASS_STEP_DIR) {
+    if (hpg->config.step_class[i] == eCLASS_STEP_DIR || hpg->config.step_class[i] == eCLASS_STEP_DIR_CL ||
+        hpg->config.step_class[i] == eCLASS_STEP_GEAR || updown) {
 				rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.stepspace", hpg->config.name, i);
 				r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.dir.stepspace), hpg->config.comp_id);
 				if (r < 0) {
@@ -598,14 +657,14 @@ static int export_stepdir(hal_pru_generic_t *hpg, int i) {
 				return r;
 		}
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.steppin", hpg->config.name, i);
+    rtapi_snprintf(name, sizeof(name), updown ? "%s.stepgen.%02d.uppin" : "%s.stepgen.%02d.steppin", hpg->config.name, i);
     r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.dir.steppin), hpg->config.comp_id);
     if (r < 0) {
         HPG_ERR("Error adding param '%s', aborting\n", name);
         return r;
     }
 
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.dirpin", hpg->config.name, i);
+    rtapi_snprintf(name, sizeof(name), updown ? "%s.stepgen.%02d.downpin" : "%s.stepgen.%02d.dirpin", hpg->config.name, i);
     r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.dir.dirpin), hpg->config.comp_id);
     if (r < 0) {
         HPG_ERR("Error adding param '%s', aborting\n", name);
@@ -671,6 +730,188 @@ static int export_stepphase(hal_pru_generic_t *hpg, int i) {
     return 0;
 }
 
+static int export_stepcl(hal_pru_generic_t *hpg, int i) {
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // closed loop stepgen has all step/dir pins and parameters
+    r = export_stepdir(hpg, i);
+    if (r < 0) {
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.cl-enable", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_IN, &(hpg->stepgen.instance[i].hal.pin.cl_enable), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.following-error", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.following_error), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.correction-steps", hpg->config.name, i);
+    r = hal_pin_s32_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.correction_steps), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.cl-encoder", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.cl.encoder), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.cl-counts-per-step", hpg->config.name, i);
+    r = hal_param_float_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.cl.counts_per_step), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.cl-deadband", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.cl.deadband), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.cl-max-error", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.cl.max_error), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    *(hpg->stepgen.instance[i].hal.pin.cl_enable) = 0;
+    *(hpg->stepgen.instance[i].hal.pin.following_error) = 0.0;
+    *(hpg->stepgen.instance[i].hal.pin.correction_steps) = 0;
+
+    hpg->stepgen.instance[i].hal.param.cl.encoder = 0;
+    hpg->stepgen.instance[i].hal.param.cl.counts_per_step = 1.0;
+    hpg->stepgen.instance[i].hal.param.cl.deadband = 2;
+    hpg->stepgen.instance[i].hal.param.cl.max_error = 100;
+
+    return 0;
+}
+
+static int export_stepgear(hal_pru_generic_t *hpg, int i) {
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    // geared stepgen has all step/dir pins and parameters
+    r = export_stepdir(hpg, i);
+    if (r < 0) {
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-enable", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_IN, &(hpg->stepgen.instance[i].hal.pin.gear_enable), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-ratio", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_IN, &(hpg->stepgen.instance[i].hal.pin.gear_ratio), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-sync-error", hpg->config.name, i);
+    r = hal_pin_float_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.gear_sync_error), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-locked", hpg->config.name, i);
+    r = hal_pin_bit_new(name, HAL_OUT, &(hpg->stepgen.instance[i].hal.pin.gear_locked), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding pin '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-encoder", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.gear.encoder), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.gear-blend-time", hpg->config.name, i);
+    r = hal_param_float_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.gear.blend_time), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    *(hpg->stepgen.instance[i].hal.pin.gear_enable) = 0;
+    *(hpg->stepgen.instance[i].hal.pin.gear_ratio) = 0.0;
+    *(hpg->stepgen.instance[i].hal.pin.gear_sync_error) = 0.0;
+    *(hpg->stepgen.instance[i].hal.pin.gear_locked) = 0;
+
+    hpg->stepgen.instance[i].hal.param.gear.encoder = 0;
+    hpg->stepgen.instance[i].hal.param.gear.blend_time = 0.1;
+
+    return 0;
+}
+
+static int export_stepmicro(hal_pru_generic_t *hpg, int i) {
+    char name[HAL_NAME_LEN + 1];
+    int r;
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.duty-pin-a", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.phase.pin_a), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.duty-pin-b", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.phase.pin_b), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.sign-pin-a", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.phase.pin_c), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.sign-pin-b", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.phase.pin_d), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    rtapi_snprintf(name, sizeof(name), "%s.stepgen.%02d.microsteps", hpg->config.name, i);
+    r = hal_param_u32_new(name, HAL_RW, &(hpg->stepgen.instance[i].hal.param.phase.microsteps), hpg->config.comp_id);
+    if (r < 0) {
+        HPG_ERR("Error adding param '%s', aborting\n", name);
+        return r;
+    }
+
+    hpg->stepgen.instance[i].hal.param.phase.pin_a = PRU_DEFAULT_PIN;
+    hpg->stepgen.instance[i].hal.param.phase.pin_b = PRU_DEFAULT_PIN;
+    hpg->stepgen.instance[i].hal.param.phase.pin_c = PRU_DEFAULT_PIN;
+    hpg->stepgen.instance[i].hal.param.phase.pin_d = PRU_DEFAULT_PIN;
+    hpg->stepgen.instance[i].hal.param.phase.microsteps = 16;
+
+    return 0;
+}
+
 int hpg_stepgen_init(hal_pru_generic_t *hpg){
     int r,i;
 
@@ -694,13 +935,18 @@ int hpg_stepgen_init(hal_pru_generic_t *hpg){
     memset(hpg->stepgen.instance, 0, (sizeof(hpg_stepgen_instance_t) * hpg->stepgen.num_instances) );
 
     for (i=0; i < hpg->stepgen.num_instances; i++) {
-        hpg->stepgen.instance[i].task.addr = pru_malloc(hpg, sizeof(hpg->stepgen.instance[i].pru));
+        int len = sizeof(hpg->stepgen.instance[i].pru);
         switch (hpg->config.step_class[i]) {
         case eCLASS_STEP_DIR :
             hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_STEP_DIR;
             hpg->stepgen.instance[i].export_stepclass = export_stepdir;
             hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepdir_update;
             break;
+        case eCLASS_STEP_UP_DOWN :
+            hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_UP_DOWN;
+            hpg->stepgen.instance[i].export_stepclass = export_stepdir;
+            hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepdir_update;
+            break;
         case eCLASS_EDGESTEP_DIR :
         		hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_EDGESTEP_DIR;
         		hpg->stepgen.instance[i].export_stepclass = export_stepdir;
@@ -711,11 +957,32 @@ int hpg_stepgen_init(hal_pru_generic_t *hpg){
             hpg->stepgen.instance[i].export_stepclass = export_stepphase;
             hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepphase_update;
             break;
+        case eCLASS_STEP_DIR_CL :
+            hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_STEP_DIR_CL;
+            hpg->stepgen.instance[i].export_stepclass = export_stepcl;
+            hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepcl_update;
+            len += sizeof(hpg->stepgen.instance[i].pru_cl);
+            break;
+        case eCLASS_STEP_GEAR :
+            hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_STEP_GEAR;
+            hpg->stepgen.instance[i].export_stepclass = export_stepgear;
+            hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepgear_update;
+            len += sizeof(hpg->stepgen.instance[i].pru_gear);
+            break;
+        case eCLASS_STEP_MICRO :
+            hpg->stepgen.instance[i].pru.task.hdr.mode = eMODE_STEP_MICRO;
+            hpg->stepgen.instance[i].export_stepclass = export_stepmicro;
+            hpg->stepgen.instance[i].stepgen_updateclass = hpg_stepmicro_update;
+            if (hpg->stepgen.sine_table == 0) {
+                hpg->stepgen.sine_table = pru_malloc(hpg, MICRO_TABLE_LEN * sizeof(rtapi_u16));
+            }
+            break;
         default :
             rtapi_print_msg(RTAPI_MSG_ERR,
                     "%s: ERROR: unknown step generator class %i\n", hpg->config.name,hpg->config.step_class[i]);
             return -1;
         }
+        hpg->stepgen.instance[i].task.addr = pru_malloc(hpg, len);
         pru_task_add(hpg, &(hpg->stepgen.instance[i].task));
 
         if ((r = export_stepgen(hpg,i)) != 0){
@@ -792,7 +1059,8 @@ static void hpg_stepdir_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t
         instance->written_dirsetup  = instance->hal.param.dir.dirsetup;
     }
 
-    if (hpg->config.step_class[i] == eCLASS_STEP_DIR) {
+    if (hpg->config.step_class[i] == eCLASS_STEP_DIR || hpg->config.step_class[i] == eCLASS_STEP_DIR_CL ||
+        hpg->config.step_class[i] == eCLASS_STEP_UP_DOWN || hpg->config.step_class[i] == eCLASS_STEP_GEAR) {
 				if (instance->hal.param.dir.stepspace != instance->written_stepspace) {
 						instance->pru.stepspace  = ns2periods(hpg, instance->hal.param.dir.stepspace);
 						pru->stepspace  = instance->pru.stepspace;
@@ -806,9 +1074,7 @@ static void hpg_stepdir_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t
     }
 }
 
-static void hpg_stepphase_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru) {
-    hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
-
+static void hpg_stepphase_update_pins(hpg_stepgen_instance_t *instance, PRU_task_stepgen_t *pru) {
     // Update shadow of PRU control registers
     if (instance->pru.task.hdr.dataX != instance->hal.param.phase.pin_a) {
         instance->pru.task.hdr.dataX   = instance->hal.param.phase.pin_a;
@@ -828,6 +1094,12 @@ static void hpg_stepphase_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen
         instance->pru.pin.d = instance->hal.param.phase.pin_d;
         pru->pin.d      = instance->pru.pin.d;
     }
+}
+
+static void hpg_stepphase_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru) {
+    hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
+
+    hpg_stepphase_update_pins(instance, pru);
 
     if (instance->hal.param.phase.type != instance->written_phase) {
         instance->pru.lut = create_lut(instance);
@@ -836,11 +1108,146 @@ static void hpg_stepphase_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen
     }
 }
 
+static void hpg_stepcl_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru) {
+    hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
+    PRU_stepgen_cl_t *pru_cl = (PRU_stepgen_cl_t *) (pru + 1);
+    pru_addr_t enc_addr;
+    rtapi_u8 flags;
+
+    hpg_stepdir_update(hpg, i, pru);
+
+    enc_addr = hpg_encoder_count_addr(hpg, instance->hal.param.cl.encoder);
+    if (enc_addr != instance->pru_cl.enc_addr) {
+        if (enc_addr == 0) {
+            HPG_ERR("stepgen.%02d.cl-encoder %d does not exist, closed loop disabled\n", i, instance->hal.param.cl.encoder);
+        }
+        instance->pru_cl.enc_addr = enc_addr;
+        pru_cl->enc_addr = instance->pru_cl.enc_addr;
+    }
+
+    if (instance->hal.param.cl.counts_per_step != instance->written_counts_per_step) {
+        instance->pru_cl.counts_per_step = instance->hal.param.cl.counts_per_step * 65536.0;
+        pru_cl->counts_per_step = instance->pru_cl.counts_per_step;
+        instance->written_counts_per_step = instance->hal.param.cl.counts_per_step;
+    }
+
+    if (instance->hal.param.cl.deadband > 0xFFFF)
+        instance->hal.param.cl.deadband = 0xFFFF;
+    if (instance->hal.param.cl.max_error > 0xFFFF)
+        instance->hal.param.cl.max_error = 0xFFFF;
+
+    if (instance->hal.param.cl.deadband != instance->pru_cl.deadband || instance->hal.param.cl.max_error != instance->pru_cl.max_error) {
+        instance->pru_cl.deadband = instance->hal.param.cl.deadband;
+        instance->pru_cl.max_error = instance->hal.param.cl.max_error;
+        pru_cl->deadband = instance->pru_cl.deadband;
+        pru_cl->max_error = instance->pru_cl.max_error;
+    }
+
+    // The PRU keeps the expected position synchronized with the encoder as
+    // long as the correction is disabled
+    flags = 0;
+    if (*(instance->hal.pin.cl_enable) && *(instance->hal.pin.enable) && instance->pru_cl.enc_addr != 0)
+        flags |= PRU_STEPCL_ENABLE;
+
+    if (flags != instance->pru_cl.flags) {
+        instance->pru_cl.flags = flags;
+        pru_cl->flags = instance->pru_cl.flags;
+    }
+}
+
+//
+// Gear ratio in signed 16.16 steps per encoder count, and the change of the
+// ratio per PRU period that ramps it in from zero within gear-blend-time
+//
+static rtapi_s32 hpg_stepgear_ratio(hpg_stepgen_instance_t *instance) {
+    double ratio = *(instance->hal.pin.gear_ratio) * instance->hal.param.position_scale * 65536.0;
+
+    if (ratio > RTAPI_INT32_MAX) ratio = RTAPI_INT32_MAX;
+    if (ratio < -RTAPI_INT32_MAX) ratio = -RTAPI_INT32_MAX;
+
+    return ratio;
+}
+
+static rtapi_u32 hpg_stepgear_blend_step(hal_pru_generic_t *hpg, hpg_stepgen_instance_t *instance) {
+    double step;
+
+    if (instance->hal.param.gear.blend_time <= 0.0) {
+        instance->hal.param.gear.blend_time = 0.0;
+        return RTAPI_INT32_MAX;
+    }
+
+    step = fabs((double)instance->pru_gear.ratio) * hpg->config.pru_period * 1e-9 / instance->hal.param.gear.blend_time;
+    if (step > RTAPI_INT32_MAX) step = RTAPI_INT32_MAX;
+    if (step < 1.0) step = 1.0;
+
+    return step;
+}
+
+static void hpg_stepgear_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru) {
+    hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
+    PRU_stepgen_gear_t *pru_gear = (PRU_stepgen_gear_t *) (pru + 1);
+    pru_addr_t enc_addr;
+    rtapi_u8 flags;
+    rtapi_s32 ratio;
+    rtapi_u32 blend_step;
+
+    hpg_stepdir_update(hpg, i, pru);
+
+    enc_addr = hpg_encoder_count_addr(hpg, instance->hal.param.gear.encoder);
+    if (enc_addr != instance->pru_gear.enc_addr) {
+        if (enc_addr == 0) {
+            HPG_ERR("stepgen.%02d.gear-encoder %d does not exist, gearing disabled\n", i, instance->hal.param.gear.encoder);
+        }
+        instance->pru_gear.enc_addr = enc_addr;
+        pru_gear->enc_addr = instance->pru_gear.enc_addr;
+    }
+
+    ratio = hpg_stepgear_ratio(instance);
+    if (ratio != instance->pru_gear.ratio) {
+        instance->pru_gear.ratio = ratio;
+        pru_gear->ratio = instance->pru_gear.ratio;
+    }
+
+    blend_step = hpg_stepgear_blend_step(hpg, instance);
+    if (blend_step != instance->pru_gear.blend_step) {
+        instance->pru_gear.blend_step = blend_step;
+        pru_gear->blend_step = instance->pru_gear.blend_step;
+    }
+
+    // While engaged the PRU ignores the commanded rate, while disengaged it
+    // keeps the encoder tracked from zero ratio
+    flags = 0;
+    if (*(instance->hal.pin.gear_enable) && *(instance->hal.pin.enable) && instance->pru_gear.enc_addr != 0)
+        flags |= PRU_STEPGEAR_ENABLE;
+
+    if (flags != instance->pru_gear.flags) {
+        instance->pru_gear.flags = flags;
+        pru_gear->flags = instance->pru_gear.flags;
+    }
+}
+
+static void hpg_stepmicro_update(hal_pru_generic_t *hpg, int i, PRU_task_stepgen_t *pru) {
+    hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
+
+    // duty outputs and sign pins are handled like the 4 phase pins
+    hpg_stepphase_update_pins(instance, pru);
+
+    if (instance->hal.param.phase.microsteps != instance->written_phase) {
+        instance->pru.micro.mask = create_microstep_mask(instance);
+        pru->micro.mask = instance->pru.micro.mask;
+        instance->written_phase = instance->hal.param.phase.microsteps;
+    }
+}
+
 void hpg_stepgen_force_write(hal_pru_generic_t *hpg) {
     int i;
 
     if (hpg->stepgen.num_instances <= 0) return;
 
+    if (hpg->stepgen.sine_table != 0) {
+        write_sine_table(hpg);
+    }
+
     for (i = 0; i < hpg->stepgen.num_instances; i ++) {
 
         hpg_stepgen_instance_t *instance = &(hpg->stepgen.instance[i]);
@@ -851,7 +1258,8 @@ void hpg_stepgen_force_write(hal_pru_generic_t *hpg) {
         instance->pru.rate             = 0;
         instance->pru.steplen          = ns2periods(hpg, instance->hal.param.steplen);
         instance->pru.dirhold          = ns2periods(hpg, instance->hal.param.dirhold);
-        if (mode == eMODE_STEP_DIR || mode == eMODE_EDGESTEP_DIR) {
+        if (mode == eMODE_STEP_DIR || mode == eMODE_EDGESTEP_DIR || mode == eMODE_STEP_DIR_CL || mode == eMODE_UP_DOWN ||
+            mode == eMODE_STEP_GEAR) {
             instance->pru.task.hdr.dataX = instance->hal.param.dir.steppin;
             instance->pru.task.hdr.dataY = instance->hal.param.dir.dirpin;
             instance->pru.stepspace      = ns2periods(hpg, instance->hal.param.dir.stepspace);
@@ -866,6 +1274,15 @@ void hpg_stepgen_force_write(hal_pru_generic_t *hpg) {
             instance->pru.pin.d          = instance->hal.param.phase.pin_d;
             instance->pru.reserved0      = 0;
             instance->pru.lut            = create_lut(instance);
+        } else if (mode == eMODE_STEP_MICRO) {
+            instance->pru.task.hdr.dataX = instance->hal.param.phase.pin_a;
+            instance->pru.task.hdr.dataY = instance->hal.param.phase.pin_b;
+            instance->pru.pin.c          = instance->hal.param.phase.pin_c;
+            instance->pru.pin.d          = instance->hal.param.phase.pin_d;
+            instance->pru.reserved0      = 0;
+            instance->pru.micro.mask     = create_microstep_mask(instance);
+            instance->pru.lut            = hpg->stepgen.sine_table;
+            instance->written_phase      = instance->hal.param.phase.microsteps;
         }
         instance->pru.accum          = 0;
         instance->pru.pos            = 0;
@@ -873,6 +1290,37 @@ void hpg_stepgen_force_write(hal_pru_generic_t *hpg) {
 
         PRU_task_stepgen_t *pru = (PRU_task_stepgen_t *) ((rtapi_u32) hpg->pru_data + (rtapi_u32) instance->task.addr);
         *pru = instance->pru;
+
+        if (mode == eMODE_STEP_DIR_CL) {
+            instance->pru_cl.enc_addr        = hpg_encoder_count_addr(hpg, instance->hal.param.cl.encoder);
+            instance->pru_cl.flags           = 0;
+            instance->pru_cl.reserved        = 0;
+            instance->pru_cl.deadband        = instance->hal.param.cl.deadband;
+            instance->pru_cl.max_error       = instance->hal.param.cl.max_error;
+            instance->pru_cl.counts_per_step = instance->hal.param.cl.counts_per_step * 65536.0;
+            instance->pru_cl.expected        = 0;
+            instance->pru_cl.corrections     = 0;
+            instance->pru_cl.ferror          = 0;
+            instance->written_counts_per_step = instance->hal.param.cl.counts_per_step;
+
+            PRU_stepgen_cl_t *pru_cl = (PRU_stepgen_cl_t *) (pru + 1);
+            *pru_cl = instance->pru_cl;
+        }
+
+        if (mode == eMODE_STEP_GEAR) {
+            instance->pru_gear.enc_addr      = hpg_encoder_count_addr(hpg, instance->hal.param.gear.encoder);
+            instance->pru_gear.flags         = 0;
+            instance->pru_gear.reserved1     = 0;
+            instance->pru_gear.ratio         = hpg_stepgear_ratio(instance);
+            instance->pru_gear.blend_step    = hpg_stepgear_blend_step(hpg, instance);
+            instance->pru_gear.eff_ratio     = 0;
+            instance->pru_gear.enc_last      = 0;
+            instance->pru_gear.reserved      = 0;
+            instance->pru_gear.error         = 0;
+
+            PRU_stepgen_gear_t *pru_gear = (PRU_stepgen_gear_t *) (pru + 1);
+            *pru_gear = instance->pru_gear;
+        }
     }
 }
 
@@ -895,3 +1343,29 @@ static rtapi_u32 create_lut(hpg_stepgen_instance_t *instance)
     }
     return ret;
 }
+
+static rtapi_u8 create_microstep_mask(hpg_stepgen_instance_t *instance)
+{
+    // the sine table has 64 entries per full step, coarser resolutions
+    // simply ignore the low index bits
+    hal_u32_t microsteps = instance->hal.param.phase.microsteps;
+    if (microsteps == 0 || microsteps > 64 || (microsteps & (microsteps - 1)) != 0) {
+        HPG_ERR("stepgen: microsteps %d invalid: allowed 1, 2, 4, 8, 16, 32 or 64\n", microsteps);
+        microsteps = 16;
+        instance->hal.param.phase.microsteps = microsteps;
+    }
+
+    return ~(64 / microsteps - 1) & 0xFF;
+}
+
+static void write_sine_table(hal_pru_generic_t *hpg)
+{
+    rtapi_u16 *table = (rtapi_u16 *) ((rtapi_u32) hpg->pru_data + hpg->stepgen.sine_table);
+    int j;
+
+    for (j = 0; j < MICRO_TABLE_LEN; j++) {
+        double v = sin(2.0 * M_PI * j / MICRO_TABLE_LEN) * MICRO_FULL_SCALE;
+        rtapi_u16 mag = floor(fabs(v) + 0.5);
+        table[j] = (v < 0.0) ? (mag | MICRO_SIGN) : mag;
+    }
+}
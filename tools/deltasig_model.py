@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# Host-side reference model of the PRU delta-sigma task (pru_deltasigma.asm)
+# and its output noise benchmark.
+#
+# Both modulators are modelled with the integer arithmetic the PRU uses.  The
+# pin output is run through a two-pole RC low-pass filter, and the mean error
+# and rms ripple of the filtered output are printed for first and second
+# order, for a list of values over the 14-bit range 0x0000..0x4000.  With
+# --sweep N only the worst and average ripple over N evenly spaced values is
+# printed.
+#
+# Usage: deltasig_model.py [-t ticks] [-a alpha_shift] [-s N] [value ...]
+#
+# This file is part of LinuxCNC HAL
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+
+import argparse
+import math
+
+FULL_SCALE = 0x4000
+
+
+def first_order(value, ticks):
+    integrate = 0
+    for _ in range(ticks):
+        # ADD, then bit 14 is the output and clearing it feeds it back
+        integrate = (integrate + value) & 0xFFFF
+        out = (integrate >> 14) & 1
+        integrate &= ~0xC000
+        yield out
+
+
+def signed16(x):
+    return x - 0x10000 if x & 0x8000 else x
+
+
+def second_order(value, ticks):
+    integrate = 0
+    integrate2 = 0
+    for _ in range(ticks):
+        # Feed back full scale if the last output was on (Integrate2 >= 0)
+        feedback = 0 if integrate2 & 0x8000 else FULL_SCALE
+
+        i1 = signed16(integrate) + value - feedback
+        i1 = max(-0x7FFF, min(0x7FFF, i1))
+        i2 = signed16(integrate2) + i1 - feedback
+        i2 = max(-0x7FFF, min(0x7FFF, i2))
+
+        integrate = i1 & 0xFFFF
+        integrate2 = i2 & 0xFFFF
+        yield 1 if i2 >= 0 else 0
+
+
+def filtered(samples, alpha_shift, settle):
+    # Two cascaded RC poles, y += (x - y) * 2^-alpha_shift
+    alpha = 1.0 / (1 << alpha_shift)
+    y1 = y2 = 0.0
+    for n, x in enumerate(samples):
+        y1 += (x - y1) * alpha
+        y2 += (y1 - y2) * alpha
+        if n >= settle:
+            yield y2
+
+
+def measure(model, value, ticks, alpha_shift):
+    settle = ticks // 8
+    ys = list(filtered(model(value, ticks), alpha_shift, settle))
+    mean = sum(ys) / len(ys)
+    rms = math.sqrt(sum((y - mean) ** 2 for y in ys) / len(ys))
+    return mean - float(value) / FULL_SCALE, rms
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('-t', '--ticks', type=int, default=65536,
+                        help='PRU ticks to simulate per value')
+    parser.add_argument('-a', '--alpha-shift', type=int, default=5,
+                        help='filter pole is 2^-ALPHA_SHIFT (default 5 = 1/32)')
+    parser.add_argument('-s', '--sweep', type=int, default=0,
+                        help='summarize N evenly spaced values instead')
+    parser.add_argument('values', nargs='*',
+                        help='values to measure (default: a sweep)')
+    args = parser.parse_args()
+
+    if args.sweep:
+        values = [FULL_SCALE * (n + 1) // (args.sweep + 1)
+                  for n in range(args.sweep)]
+        rms = [[measure(model, value, args.ticks, args.alpha_shift)[1]
+                for value in values]
+               for model in (first_order, second_order)]
+        for name, r in zip(('1st', '2nd'), rms):
+            worst = max(range(len(values)), key=lambda n: r[n])
+            print('%s order: worst rms %.5f at 0x%04x, average rms %.5f' %
+                  (name, r[worst], values[worst], sum(r) / len(r)))
+        return
+
+    if args.values:
+        values = [int(v, 0) for v in args.values]
+    else:
+        values = [0x0000, 0x0010, 0x0100, 0x0800, 0x1000, 0x1555, 0x2000,
+                  0x2abc, 0x3000, 0x3800, 0x3f00, 0x3ff0, 0x4000]
+
+    print('value    1st mean err  1st rms   2nd mean err  2nd rms   ratio')
+    for value in values:
+        e1, r1 = measure(first_order, value, args.ticks, args.alpha_shift)
+        e2, r2 = measure(second_order, value, args.ticks, args.alpha_shift)
+        ratio = '%6.2f' % (r1 / r2) if r2 > 0 else '     -'
+        print('0x%04x  %+12.6f  %.5f  %+12.6f  %.5f  %s' %
+              (value, e1, r1, e2, r2, ratio))
+
+
+if __name__ == '__main__':
+    main()